@@ -30,9 +30,15 @@
  */
 
 #include "Python.h"
+#include "structmember.h"
 #include <signal.h>
 #include <iconv.h>
 #include <float.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "as400_types.h"
 #include "as400_protos.h"
 
@@ -40,29 +46,113 @@
 #define OPEN_READ 10
 #define OPEN_UPDATE 12
 #define OPEN_WRITE 14
+#define OPEN_ARRIVAL 16     /* read in arrival sequence */
+/* batch commands, reads use the read operation codes */
+#define CMD_POSB 31
+#define CMD_POSA 32
+#define CMD_POSF 33
+#define CMD_POSL 34
+#define CMD_READEQ 41
+#define CMD_READRRN 42
+#define CMD_WRITE 51
+#define CMD_UPDATE 52
+#define CMD_DELETE 53
+#define CMD_RLSLOCK 54
+/* predicate operators */
+#define PRED_EQ 1
+#define PRED_NE 2
+#define PRED_LT 3
+#define PRED_LE 4
+#define PRED_GT 5
+#define PRED_GE 6
+#define PRED_IN 7
+#define PRED_BETWEEN 8
+#define PRED_FALSE 9
+#define PRED_TRUE 0         /* not sent, the condition is left out */
+/* where value compared to the values the field can hold */
+#define PV_EXACT 0
+#define PV_BELOW 1          /* the closest field value below is stored */
+#define PV_ABOVE 2          /* the closest field value above is stored */
+#define PV_LOW 3            /* less than every field value */
+#define PV_HIGH 4           /* greater than every field value */
+/* aggregates and aggregate state */
+#define AGG_SUM 1
+#define AGG_MIN 2
+#define AGG_MAX 3
+#define AGG_READ 0
+#define AGG_END 1
+#define AGG_DONE 2
+#define AGG_BLOCK 65536
 /* output */
 #define LIST 0
 #define OBJ 1
 #define DICT 2
 
 static char reclevacc_lib[11] = "";
+/* directory for saved file descriptions, NULL if not used */
+static char *schemaDir = NULL;
 
 static long int convccsid_array[30];
 static iconv_t convdesc_array[30];
 static int conv_size = 0;
 
 extern PyTypeObject File400_Type;
+extern PyTypeObject Row_Type;
+extern PyTypeObject RowIter_Type;
+extern PyTypeObject Column_Type;
+extern PyTypeObject Scan_Type;
 
 #define File400Object_Check(v) ((v)->ob_type == &File400_Type)
 #define PyClass_Check(obj) PyObject_IsInstance(obj, (PyObject *)&PyType_Type)
 
 static PyObject *file400Error;
 static PyObject *fileRowClass;
+static PyObject *decimalType = NULL;
 
 static result_type_t result_type = RESULT_INT32;
 
 static unsigned long long actmark = 0;
 
+/* value of the two digits in a packed byte (high nibble * 10 + low nibble) */
+static const unsigned char packedDigits[256] = {
+      0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+     10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25,
+     20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,
+     30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,  41,  42,  43,  44,  45,
+     40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  52,  53,  54,  55,
+     50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,
+     60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,
+     70,  71,  72,  73,  74,  75,  76,  77,  78,  79,  80,  81,  82,  83,  84,  85,
+     80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
+     90,  91,  92,  93,  94,  95,  96,  97,  98,  99, 100, 101, 102, 103, 104, 105,
+    100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115,
+    110, 111, 112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125,
+    120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+    130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143, 144, 145,
+    140, 141, 142, 143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155,
+    150, 151, 152, 153, 154, 155, 156, 157, 158, 159, 160, 161, 162, 163, 164, 165
+};
+
+/* packed byte of a two digit value */
+static const unsigned char bcdBytes[100] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99
+};
+
+/* powers of ten, exact as double up to 10^22 */
+static const double dblPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
 
 /* File info */
 typedef struct {
@@ -89,6 +179,138 @@ typedef struct {
 	int  dft;
 } fieldInfoStruct;
 
+/* Batch command, followed by size bytes of key or field patches */
+typedef struct {
+	short    oper;
+	short    lock;
+	int      arg;               /* key length, rrn or number of patches */
+	int      size;              /* a multiple of 4 */
+} CmdHead;
+
+/* Field patch for write and update, followed by len bytes rounded to 4 */
+typedef struct {
+	int      offset;
+	int      len;
+} CmdPatch;
+
+/* Predicate program, followed by the end key and the conditions */
+typedef struct {
+	int      size;              /* size of the program */
+	int      count;             /* number of conditions, all must be true */
+	int      endCnt;            /* key fields in the end key, 0 if none */
+	int      endLen;            /* length of the end key, rounded to 4 */
+} PredProgram;
+
+/* Condition, followed by count values in the field format, each rounded to 4 */
+typedef struct {
+	short    op;
+	short    count;
+	int      field;             /* position in fieldArr */
+	int      size;              /* bytes of values */
+} PredCond;
+
+/*
+ * Aggregate spec, followed by the aggregates and the open group.
+ * A group is the group key, the record count and the aggregate values.
+ */
+typedef struct {
+	int      size;              /* size of the spec */
+	int      count;             /* number of aggregates */
+	int      groupLen;          /* length of the group key, the first key fields */
+	int      countOffset;       /* offset of the record count in a group */
+	int      outLen;            /* size of a group */
+	int      curOffset;         /* offset of the open group in the spec */
+	int      state;             /* AGG_READ, AGG_END, AGG_DONE */
+	int      reserved;
+} AggSpec;
+
+typedef struct {
+	short    op;
+	short    reserved;
+	int      field;             /* position in fieldArr */
+	int      offset;            /* offset of the value in a group */
+	int      len;               /* 16 for a sum, field length for min and max */
+} AggDef;
+
+/* Format identification, from the header of the file description */
+typedef struct {
+	char lib[11];
+	char recName[11];
+	char recId[14];
+} FormatId;
+
+/* Saved file description, followed by the fields and the key fields */
+#define SCHEMA_MAGIC "F400SCHM"
+#define SCHEMA_VERSION 1
+typedef struct {
+	char     magic[8];
+	int      version;
+	int      size;              /* size of the file */
+	unsigned int checksum;      /* fnv-1a of the rest of the file */
+	FormatId id;
+	FileInfo fi;
+} schemaHeader;
+
+/*
+ * Read-ahead ring, the blocks are filled by a thread without the GIL.
+ * Reads as readmany, or an rrn range as fileReadrange when to > 0.
+ */
+typedef struct {
+	int      depth;             /* blocks in the ring */
+	int      n;                 /* records in a block */
+	int      oper;              /* 11 readn, 21 readne */
+	int      keyLen;
+	int      recLen;            /* bytes of a record in a block */
+	int      fileno;
+	int      from;              /* rrn range, first block positions on from */
+	int      to;
+	int      step;              /* chunks of n rrns this far apart, 0 reads from to to */
+	char    *pred;              /* for the range, can be NULL */
+	int     *ranges;
+	PyThread_type_lock lock;    /* lock of the file, NULL for a range */
+	volatile int stop;          /* set to stop the thread */
+	int      started;           /* thread started by the first read */
+	int      tail;              /* block read by the consumer */
+	int      held;              /* the tail block is filled and held */
+	int      pos;               /* next record in the tail block */
+	int      lastRrn;           /* last record given out, 0 if none */
+	int     *count;             /* records in each block, 0 at end, -1 on error */
+	int     *chunk;             /* first rrn of the chunk read into each block */
+	int     *rrns;
+	char    *buf;
+	PyThread_type_lock *full;   /* released when the block is filled */
+	PyThread_type_lock *empty;  /* released when the block is read */
+	PyThread_type_lock exited;  /* released by the thread as its last action */
+} Prefetch;
+
+/* Precompiled field converter, one for each field in the record */
+typedef struct fieldPlanStruct fieldPlan;
+typedef PyObject *(*cvtFunc)(char *rec, fieldPlan *fp);
+struct fieldPlanStruct {
+    cvtFunc  cvt;       /* converter for the field type */
+    int      offset;
+    int      len;
+    int      digits;
+    int      dec;
+    iconv_t  cd;        /* conversion descriptor for ebcdic fields */
+    struct sbcsTableStruct *sbcs;   /* table for single byte ebcdic */
+    cvtFunc  base;      /* converter behind the string cache */
+    struct strCacheStruct *cache;   /* strings for fields with few values */
+    fieldInfoStruct *field;
+};
+
+/* Cache of strings for a field with few distinct values */
+#define STRCACHE_SIZE 64        /* slots, power of two */
+#define STRCACHE_MAXLEN 32      /* max field length for automatic cache */
+#define STRCACHE_MISSES 1024    /* misses on a full automatic cache before it's dropped */
+typedef struct strCacheStruct {
+    int       count;            /* slots used */
+    int       misses;           /* misses when full */
+    int       automatic;        /* dropped if the field has too many values */
+    PyObject *obj[STRCACHE_SIZE];
+    char     *keys;             /* raw field value for each slot */
+} strCache;
+
 /* File object type */
 typedef struct {
 	PyObject_HEAD
@@ -98,19 +320,54 @@ typedef struct {
 	fieldInfoStruct *keyArr;
     PyObject *fieldDict;	/* dictionary over fields */
     PyObject *keyDict;	    /* dictionary over keys */
+    PyObject *decimal;      /* decimal option, True or sequence of fields */
+    char *decArr;           /* fields returned as Decimal */
+    PyObject *cache;        /* string cache option, True or sequence of fields */
+    fieldPlan *plan;        /* converters for the fields */
     char *recbuf;
+    int exports;            /* buffer views of recbuf */
+    PyThread_type_lock lock; /* one thread at a time in the service program */
+    Prefetch *prefetch;     /* read-ahead, NULL if not used */
+    PyThread_type_lock pflock; /* one reader of the read-ahead at a time */
 } File400Object;
 
+/* take a lock, waiting without the GIL */
+static void
+f_acquire(PyThread_type_lock lock)
+{
+    if (!PyThread_acquire_lock(lock, NOWAIT_LOCK)) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+/* take the file lock, waiting without the GIL */
+static void
+f_lock(File400Object *self)
+{
+    f_acquire(self->lock);
+}
+
+static void
+f_prefetchStop(File400Object *self, int restore);
+
+/* call the service program without the GIL, result is -1 if the file was closed meanwhile */
+#define FILE_IO(self, result, call) \
+    do { \
+        result = -1; \
+        if ((self)->prefetch != NULL) \
+            f_prefetchStop(self, 1); \
+        Py_BEGIN_ALLOW_THREADS \
+        PyThread_acquire_lock((self)->lock, WAIT_LOCK); \
+        if ((self)->recbuf != NULL) \
+            result = (call); \
+        PyThread_release_lock((self)->lock); \
+        Py_END_ALLOW_THREADS \
+    } while (0)
+
 #define ROUND_QUAD(x) (((size_t)(x) + 0xf) & ~0xf)
 
-ILEpointer *int2zonedTarget = NULL;
-static char int2zonedTarget_buf[sizeof(ILEpointer) + 15];
-ILEpointer *float2zonedTarget = NULL;
-static char float2zonedTarget_buf[sizeof(ILEpointer) + 15];
-ILEpointer *int2packedTarget = NULL;
-static char int2packedTarget_buf[sizeof(ILEpointer) + 15];
-ILEpointer *float2packedTarget = NULL;
-static char float2packedTarget_buf[sizeof(ILEpointer) + 15];
 ILEpointer *fileNewTarget = NULL;
 static char fileNewTarget_buf[sizeof(ILEpointer) + 15];
 ILEpointer *fileInitTarget = NULL;
@@ -149,6 +406,30 @@ ILEpointer *fileReadneTarget = NULL;
 static char fileReadneTarget_buf[sizeof(ILEpointer) + 15];
 ILEpointer *fileReadpeTarget = NULL;
 static char fileReadpeTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileReadmanyTarget = NULL;
+static char fileReadmanyTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileReadselectTarget = NULL;
+static char fileReadselectTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileReadwhereTarget = NULL;
+static char fileReadwhereTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileDupTarget = NULL;
+static char fileDupTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileReadrangeTarget = NULL;
+static char fileReadrangeTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileAggregateTarget = NULL;
+static char fileAggregateTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileWriteBlockTarget = NULL;
+static char fileWriteBlockTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileExecuteTarget = NULL;
+static char fileExecuteTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *poolConfigTarget = NULL;
+static char poolConfigTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *poolStatsTarget = NULL;
+static char poolStatsTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileGetFormatIdTarget = NULL;
+static char fileGetFormatIdTarget_buf[sizeof(ILEpointer) + 15];
+ILEpointer *fileSetFormatTarget = NULL;
+static char fileSetFormatTarget_buf[sizeof(ILEpointer) + 15];
 ILEpointer *fileGetDataTarget = NULL;
 static char fileGetDataTarget_buf[sizeof(ILEpointer) + 15];
 ILEpointer *fileGetStructTarget = NULL;
@@ -186,10 +467,6 @@ static void loadSrvpgm() {
         abort();
     }
     // Load all functions
-    int2zonedTarget = loadFunction(int2zonedTarget_buf, "int2zoned");
-    float2zonedTarget = loadFunction(float2zonedTarget_buf, "float2zoned");
-    int2packedTarget = loadFunction(int2packedTarget_buf, "int2packed");
-    float2packedTarget = loadFunction(float2packedTarget_buf, "float2packed");
     fileNewTarget = loadFunction(fileNewTarget_buf, "fileNew");
     fileInitTarget = loadFunction(fileInitTarget_buf, "fileInit");
     fileOpenTarget = loadFunction(fileOpenTarget_buf, "fileOpen");
@@ -209,6 +486,18 @@ static void loadSrvpgm() {
     fileReadpTarget = loadFunction(fileReadpTarget_buf, "fileReadp");
     fileReadneTarget = loadFunction(fileReadneTarget_buf, "fileReadne");
     fileReadpeTarget = loadFunction(fileReadpeTarget_buf, "fileReadpe");
+    fileReadmanyTarget = loadFunction(fileReadmanyTarget_buf, "fileReadmany");
+    fileReadwhereTarget = loadFunction(fileReadwhereTarget_buf, "fileReadwhere");
+    fileReadselectTarget = loadFunction(fileReadselectTarget_buf, "fileReadselect");
+    fileAggregateTarget = loadFunction(fileAggregateTarget_buf, "fileAggregate");
+    fileDupTarget = loadFunction(fileDupTarget_buf, "fileDup");
+    fileReadrangeTarget = loadFunction(fileReadrangeTarget_buf, "fileReadrange");
+    fileWriteBlockTarget = loadFunction(fileWriteBlockTarget_buf, "fileWriteBlock");
+    fileExecuteTarget = loadFunction(fileExecuteTarget_buf, "fileExecute");
+    poolConfigTarget = loadFunction(poolConfigTarget_buf, "poolConfig");
+    poolStatsTarget = loadFunction(poolStatsTarget_buf, "poolStats");
+    fileGetFormatIdTarget = loadFunction(fileGetFormatIdTarget_buf, "fileGetFormatId");
+    fileSetFormatTarget = loadFunction(fileSetFormatTarget_buf, "fileSetFormat");
     fileGetDataTarget = loadFunction(fileGetDataTarget_buf, "fileGetData");
     fileGetStructTarget = loadFunction(fileGetStructTarget_buf, "fileGetStruct");
     fileGetFieldsTarget = loadFunction(fileGetFieldsTarget_buf, "fileGetFields");
@@ -220,18 +509,6 @@ static void loadSrvpgm() {
     osSystemTarget = loadFunction(osSystemTarget_buf, "osSystem");
 }
 
-typedef struct
- { ILEarglist_base base; ILEpointer buf; int32 len; int32 dec; int32 value; }
- intconv_St;
-static arg_type_t
- intconv_Sign[] = { ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_INT32, ARG_END };
-
-typedef struct
- { ILEarglist_base base; ILEpointer buf; int32 len; int32 dec; float64 value; }
- floatconv_St;
-static arg_type_t
- floatconv_Sign[] = { ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_FLOAT64, ARG_END };
-
 typedef struct
  { ILEarglist_base base; ILEpointer name; ILEpointer lib; ILEpointer mbr; int32 mode; }
  fileNew_St;
@@ -274,6 +551,60 @@ typedef struct
 static arg_type_t
  fileReadrrn_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_END };
 
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer buf; ILEpointer rrns; int32 n; int32 oper; int32 keylen; int32 lock; }
+ fileReadmany_St;
+static arg_type_t
+ fileReadmany_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_INT32, ARG_INT32, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer buf; ILEpointer rrns; int32 n; int32 oper; int32 keyLen; int32 lock; ILEpointer pred; }
+ fileReadwhere_St;
+static arg_type_t
+ fileReadwhere_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_INT32, ARG_INT32, ARG_MEMPTR, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer buf; ILEpointer rrns; int32 n; int32 oper; int32 keyLen; int32 lock; ILEpointer pred; ILEpointer ranges; ILEpointer recbuf; }
+ fileReadselect_St;
+static arg_type_t
+ fileReadselect_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_INT32, ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_MEMPTR, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer pred; ILEpointer spec; ILEpointer out; int32 max; }
+ fileAggregate_St;
+static arg_type_t
+ fileAggregate_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_MEMPTR, ARG_INT32, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; int32 mode; }
+ fileDup_St;
+static arg_type_t
+ fileDup_Sign[] = { ARG_INT32, ARG_INT32, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer buf; ILEpointer rrns; int32 n; int32 from; int32 to; ILEpointer pred; ILEpointer ranges; }
+ fileReadrange_St;
+static arg_type_t
+ fileReadrange_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_INT32, ARG_INT32, ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer buf; int32 n; ILEpointer failed; }
+ fileWriteBlock_St;
+static arg_type_t
+ fileWriteBlock_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_INT32, ARG_MEMPTR, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer cmds; int32 n; ILEpointer recbuf; ILEpointer status; ILEpointer recs; }
+ fileExecute_St;
+static arg_type_t
+ fileExecute_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_MEMPTR, ARG_END };
+
+typedef struct
+ { ILEarglist_base base; int32 fileno; ILEpointer info; ILEpointer fields; ILEpointer keys; ILEpointer id; }
+ fileSetFormat_St;
+static arg_type_t
+ fileSetFormat_Sign[] = { ARG_INT32, ARG_MEMPTR, ARG_MEMPTR, ARG_MEMPTR, ARG_MEMPTR, ARG_END };
+
 typedef struct
  { ILEarglist_base base; int32 fileno; ILEpointer buf; int32 size; }
  fileGetData_St;
@@ -292,57 +623,17 @@ typedef struct
 static arg_type_t
  osSystem_Sign[] = { ARG_MEMPTR, ARG_END };
 
-static int call_int2zoned(char *buf, int len, int dec, int value)
-{
-    char ILEarglist_buf[sizeof(intconv_St) + 15];
-    if (!actmark) loadSrvpgm();
-    intconv_St *ILEarglist = (intconv_St*)ROUND_QUAD(ILEarglist_buf);
-    ILEarglist->buf.s.addr = (ulong)buf;
-    ILEarglist->len = len;
-    ILEarglist->dec = dec;
-    ILEarglist->value = value;
-    _ILECALL(int2zonedTarget, &ILEarglist->base, intconv_Sign, result_type);
-    return ILEarglist->base.result.s_int32.r_int32;
-}
-
-static int call_float2zoned(char *buf, int len, int dec, double value)
-{
-    char ILEarglist_buf[sizeof(floatconv_St) + 15];
-    if (!actmark) loadSrvpgm();
-    floatconv_St *ILEarglist = (floatconv_St*)ROUND_QUAD(ILEarglist_buf);
-    ILEarglist->buf.s.addr = (ulong)buf;
-    ILEarglist->len = len;
-    ILEarglist->dec = dec;
-    ILEarglist->value = value;
-    _ILECALL(float2zonedTarget, &ILEarglist->base, floatconv_Sign, result_type);
-    return ILEarglist->base.result.s_int32.r_int32;
-}
-
-static int call_int2packed(char *buf, int len, int dec, int value)
-{
-    char ILEarglist_buf[sizeof(intconv_St) + 15];
-    if (!actmark) loadSrvpgm();
-    intconv_St *ILEarglist = (intconv_St*)ROUND_QUAD(ILEarglist_buf);
-    ILEarglist->buf.s.addr = (ulong)buf;
-    ILEarglist->len = len;
-    ILEarglist->dec = dec;
-    ILEarglist->value = value;
-    _ILECALL(int2packedTarget, &ILEarglist->base, intconv_Sign, result_type);
-    return ILEarglist->base.result.s_int32.r_int32;
-}
+typedef struct
+ { ILEarglist_base base; int32 size; int32 idle; }
+ poolConfig_St;
+static arg_type_t
+ poolConfig_Sign[] = { ARG_INT32, ARG_INT32, ARG_END };
 
-static int call_float2packed(char *buf, int len, int dec, double value)
-{
-    char ILEarglist_buf[sizeof(floatconv_St) + 15];
-    if (!actmark) loadSrvpgm();
-    floatconv_St *ILEarglist = (floatconv_St*)ROUND_QUAD(ILEarglist_buf);
-    ILEarglist->buf.s.addr = (ulong)buf;
-    ILEarglist->len = len;
-    ILEarglist->dec = dec;
-    ILEarglist->value = value;
-    _ILECALL(float2packedTarget, &ILEarglist->base, floatconv_Sign, result_type);
-    return ILEarglist->base.result.s_int32.r_int32;
-}
+typedef struct
+ { ILEarglist_base base; ILEpointer stats; }
+ poolStats_St;
+static arg_type_t
+ poolStats_Sign[] = { ARG_MEMPTR, ARG_END };
 
 static int call_fileNew(char *name, char *lib, char *mbr, int mode)
 {
@@ -566,6 +857,22 @@ static int call_fileReadp(int fileno, char *recbuf, int lock)
     return ILEarglist->base.result.s_int32.r_int32;
 }
 
+static int call_fileReadmany(int fileno, char *buf, int *rrns, int n, int oper, int keylen, int lock)
+{
+    char ILEarglist_buf[sizeof(fileReadmany_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileReadmany_St *ILEarglist = (fileReadmany_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->buf.s.addr = (ulong)buf;
+    ILEarglist->rrns.s.addr = (ulong)rrns;
+    ILEarglist->n = n;
+    ILEarglist->oper = oper;
+    ILEarglist->keylen = keylen;
+    ILEarglist->lock = lock;
+    _ILECALL(fileReadmanyTarget, &ILEarglist->base, fileReadmany_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
 static int call_fileGetData(int fileno, char *buf, int size)
 {
     char ILEarglist_buf[sizeof(fileGetData_St) + 15];
@@ -589,6 +896,32 @@ static int call_fileGetStruct(int fileno, FileInfo *info)
     return ILEarglist->base.result.s_int32.r_int32;
 }
 
+static int call_fileGetFormatId(int fileno, FormatId *id)
+{
+    char ILEarglist_buf[sizeof(fileBuf_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileBuf_St *ILEarglist = (fileBuf_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->buf.s.addr = (ulong)id;
+    _ILECALL(fileGetFormatIdTarget, &ILEarglist->base, fileBuf_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileSetFormat(int fileno, FileInfo *info, fieldInfoStruct *fields,
+                              fieldInfoStruct *keys, FormatId *id)
+{
+    char ILEarglist_buf[sizeof(fileSetFormat_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileSetFormat_St *ILEarglist = (fileSetFormat_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->info.s.addr = (ulong)info;
+    ILEarglist->fields.s.addr = (ulong)fields;
+    ILEarglist->keys.s.addr = (ulong)keys;
+    ILEarglist->id.s.addr = (ulong)id;
+    _ILECALL(fileSetFormatTarget, &ILEarglist->base, fileSetFormat_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
 static int call_fileGetFields(int fileno, fieldInfoStruct *fi, int size)
 {
     char ILEarglist_buf[sizeof(fileGetData_St) + 15];
@@ -665,6 +998,350 @@ static int call_osSystem(char *cmd)
     return ILEarglist->base.result.s_int32.r_int32;
 }
 
+static int call_fileReadwhere(int fileno, char *buf, int *rrns, int n, int oper, int keyLen, int lock, char *pred)
+{
+    char ILEarglist_buf[sizeof(fileReadwhere_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileReadwhere_St *ILEarglist = (fileReadwhere_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->buf.s.addr = (ulong)buf;
+    ILEarglist->rrns.s.addr = (ulong)rrns;
+    ILEarglist->n = n;
+    ILEarglist->oper = oper;
+    ILEarglist->keyLen = keyLen;
+    ILEarglist->lock = lock;
+    ILEarglist->pred.s.addr = (ulong)pred;
+    _ILECALL(fileReadwhereTarget, &ILEarglist->base, fileReadwhere_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileReadselect(int fileno, char *buf, int *rrns, int n, int oper, int keyLen, int lock,
+                               char *pred, int *ranges, char *recbuf)
+{
+    char ILEarglist_buf[sizeof(fileReadselect_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileReadselect_St *ILEarglist = (fileReadselect_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->buf.s.addr = (ulong)buf;
+    ILEarglist->rrns.s.addr = (ulong)rrns;
+    ILEarglist->n = n;
+    ILEarglist->oper = oper;
+    ILEarglist->keyLen = keyLen;
+    ILEarglist->lock = lock;
+    ILEarglist->pred.s.addr = (ulong)pred;
+    ILEarglist->ranges.s.addr = (ulong)ranges;
+    ILEarglist->recbuf.s.addr = (ulong)recbuf;
+    _ILECALL(fileReadselectTarget, &ILEarglist->base, fileReadselect_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileAggregate(int fileno, char *pred, char *spec, char *out, int max)
+{
+    char ILEarglist_buf[sizeof(fileAggregate_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileAggregate_St *ILEarglist = (fileAggregate_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->pred.s.addr = (ulong)pred;
+    ILEarglist->spec.s.addr = (ulong)spec;
+    ILEarglist->out.s.addr = (ulong)out;
+    ILEarglist->max = max;
+    _ILECALL(fileAggregateTarget, &ILEarglist->base, fileAggregate_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileDup(int fileno, int mode)
+{
+    char ILEarglist_buf[sizeof(fileDup_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileDup_St *ILEarglist = (fileDup_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->mode = mode;
+    _ILECALL(fileDupTarget, &ILEarglist->base, fileDup_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileReadrange(int fileno, char *buf, int *rrns, int n, int from, int to,
+                              char *pred, int *ranges)
+{
+    char ILEarglist_buf[sizeof(fileReadrange_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileReadrange_St *ILEarglist = (fileReadrange_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->buf.s.addr = (ulong)buf;
+    ILEarglist->rrns.s.addr = (ulong)rrns;
+    ILEarglist->n = n;
+    ILEarglist->from = from;
+    ILEarglist->to = to;
+    ILEarglist->pred.s.addr = (ulong)pred;
+    ILEarglist->ranges.s.addr = (ulong)ranges;
+    _ILECALL(fileReadrangeTarget, &ILEarglist->base, fileReadrange_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileWriteBlock(int fileno, char *buf, int n, int *failed)
+{
+    char ILEarglist_buf[sizeof(fileWriteBlock_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileWriteBlock_St *ILEarglist = (fileWriteBlock_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->buf.s.addr = (ulong)buf;
+    ILEarglist->n = n;
+    ILEarglist->failed.s.addr = (ulong)failed;
+    _ILECALL(fileWriteBlockTarget, &ILEarglist->base, fileWriteBlock_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_fileExecute(int fileno, char *cmds, int n, char *recbuf, int *status, char *recs)
+{
+    char ILEarglist_buf[sizeof(fileExecute_St) + 15];
+    if (!actmark) loadSrvpgm();
+    fileExecute_St *ILEarglist = (fileExecute_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->fileno = fileno;
+    ILEarglist->cmds.s.addr = (ulong)cmds;
+    ILEarglist->n = n;
+    ILEarglist->recbuf.s.addr = (ulong)recbuf;
+    ILEarglist->status.s.addr = (ulong)status;
+    ILEarglist->recs.s.addr = (ulong)recs;
+    _ILECALL(fileExecuteTarget, &ILEarglist->base, fileExecute_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_poolConfig(int size, int idle)
+{
+    char ILEarglist_buf[sizeof(poolConfig_St) + 15];
+    if (!actmark) loadSrvpgm();
+    poolConfig_St *ILEarglist = (poolConfig_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->size = size;
+    ILEarglist->idle = idle;
+    _ILECALL(poolConfigTarget, &ILEarglist->base, poolConfig_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+static int call_poolStats(int *stats)
+{
+    char ILEarglist_buf[sizeof(poolStats_St) + 15];
+    if (!actmark) loadSrvpgm();
+    poolStats_St *ILEarglist = (poolStats_St*)ROUND_QUAD(ILEarglist_buf);
+    ILEarglist->stats.s.addr = (ulong)stats;
+    _ILECALL(poolStatsTarget, &ILEarglist->base, poolStats_Sign, result_type);
+    return ILEarglist->base.result.s_int32.r_int32;
+}
+
+/* read-ahead thread, fills the blocks in turn until the end, an error or stop */
+static void
+f_prefetchRun(void *arg)
+{
+    Prefetch *pf = arg;
+    int i = 0, next, last, result, end = 0, depth = pf->depth;
+    char *buf;
+
+    do {
+        PyThread_acquire_lock(pf->empty[i], WAIT_LOCK);
+        result = 0;
+        if (!pf->stop && !end) {
+            buf = pf->buf + (size_t)i * pf->n * pf->recLen;
+            if (pf->step > 0) {
+                /* the next chunk with records, the block is the whole chunk */
+                while (result == 0 && pf->from <= pf->to && !pf->stop) {
+                    last = pf->from + pf->n - 1;
+                    result = call_fileReadrange(pf->fileno, buf, pf->rrns + i * pf->n, pf->n,
+                                                pf->from, (last < pf->to) ? last : pf->to,
+                                                pf->pred, pf->ranges);
+                    pf->chunk[i] = pf->from;
+                    pf->from += pf->step;
+                }
+                end = (pf->from > pf->to);
+            } else if (pf->to > 0) {
+                result = call_fileReadrange(pf->fileno, buf, pf->rrns + i * pf->n, pf->n,
+                                            pf->from, pf->to, pf->pred, pf->ranges);
+                pf->from = 0;
+            } else {
+                PyThread_acquire_lock(pf->lock, WAIT_LOCK);
+                result = call_fileReadmany(pf->fileno, buf, pf->rrns + i * pf->n, pf->n,
+                                           pf->oper, pf->keyLen, 0);
+                PyThread_release_lock(pf->lock);
+            }
+            /* a short block is the last, the next one marks the end */
+            if (pf->step == 0)
+                end = (result < pf->n);
+        }
+        pf->count[i] = result;
+        next = (i + 1) % depth;
+        PyThread_release_lock(pf->full[i]);
+        i = next;
+    } while (result > 0);
+    /* the ring is not freed before this */
+    PyThread_release_lock(pf->exited);
+}
+
+static void
+f_prefetchFree(Prefetch *pf)
+{
+    int i;
+
+    for (i = 0; i < pf->depth; i++) {
+        if (pf->full && pf->full[i]) PyThread_free_lock(pf->full[i]);
+        if (pf->empty && pf->empty[i]) PyThread_free_lock(pf->empty[i]);
+    }
+    if (pf->exited) PyThread_free_lock(pf->exited);
+    PyMem_Free(pf->full);
+    PyMem_Free(pf->empty);
+    PyMem_Free(pf->count);
+    PyMem_Free(pf->chunk);
+    PyMem_Free(pf->buf);
+    PyMem_Free(pf);
+}
+
+/* new ring of depth blocks of n records, the caller sets what to read */
+static Prefetch *
+f_prefetchNew(int depth, int n, int recLen)
+{
+    Prefetch *pf;
+    int i;
+
+    pf = PyMem_Calloc(1, sizeof(Prefetch));
+    if (pf == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    pf->depth = depth;
+    pf->n = n;
+    pf->recLen = recLen;
+    pf->count = PyMem_Calloc(depth, sizeof(int));
+    pf->chunk = PyMem_Calloc(depth, sizeof(int));
+    pf->full = PyMem_Calloc(depth, sizeof(PyThread_type_lock));
+    pf->empty = PyMem_Calloc(depth, sizeof(PyThread_type_lock));
+    pf->buf = PyMem_Malloc((size_t)depth * n * (pf->recLen + sizeof(int)));
+    if (pf->count == NULL || pf->chunk == NULL || pf->full == NULL || pf->empty == NULL || pf->buf == NULL) {
+        f_prefetchFree(pf);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    pf->rrns = (int *)(pf->buf + (size_t)depth * n * pf->recLen);
+    pf->exited = PyThread_allocate_lock();
+    if (pf->exited == NULL) {
+        f_prefetchFree(pf);
+        PyErr_SetString(file400Error, "Can not allocate lock.");
+        return NULL;
+    }
+    PyThread_acquire_lock(pf->exited, NOWAIT_LOCK);
+    for (i = 0; i < depth; i++) {
+        pf->full[i] = PyThread_allocate_lock();
+        pf->empty[i] = PyThread_allocate_lock();
+        if (pf->full[i] == NULL || pf->empty[i] == NULL) {
+            f_prefetchFree(pf);
+            PyErr_SetString(file400Error, "Can not allocate lock.");
+            return NULL;
+        }
+        /* no block is filled yet */
+        PyThread_acquire_lock(pf->full[i], NOWAIT_LOCK);
+    }
+    return pf;
+}
+
+/* stop the thread and wait until it has exited, called without the GIL */
+static void
+f_prefetchDrain(Prefetch *pf)
+{
+    pf->stop = 1;
+    /* give back the blocks until the thread marks the end */
+    for (;;) {
+        if (!pf->held)
+            PyThread_acquire_lock(pf->full[pf->tail], WAIT_LOCK);
+        pf->held = 0;
+        if (pf->count[pf->tail] <= 0)
+            break;
+        PyThread_release_lock(pf->empty[pf->tail]);
+        pf->tail = (pf->tail + 1) % pf->depth;
+    }
+    /* the end block is marked before the thread is out of the ring locks */
+    PyThread_acquire_lock(pf->exited, WAIT_LOCK);
+}
+
+/* stop the read-ahead, restore puts the file back on the last record given out */
+static void
+f_prefetchStop(File400Object *self, int restore)
+{
+    Prefetch *pf;
+
+    if (self->prefetch == NULL)
+        return;
+    f_acquire(self->pflock);
+    pf = self->prefetch;
+    self->prefetch = NULL;
+    if (pf != NULL && pf->started) {
+        Py_BEGIN_ALLOW_THREADS
+        f_prefetchDrain(pf);
+        /* the file is positioned after the blocks read ahead */
+        if (restore && pf->lastRrn > 0) {
+            PyThread_acquire_lock(self->lock, WAIT_LOCK);
+            if (self->recbuf != NULL)
+                call_fileReadrrn(self->fileno, pf->buf, pf->lastRrn, 0);
+            PyThread_release_lock(self->lock);
+        }
+        Py_END_ALLOW_THREADS
+    }
+    PyThread_release_lock(self->pflock);
+    if (pf != NULL)
+        f_prefetchFree(pf);
+}
+
+/*
+ * Read up to n records as fileReadmany, from the read-ahead blocks when
+ * they are read the same way. The thread is started by the first read.
+ */
+static int
+f_prefetchRead(File400Object *self, int oper, int keyLen, char *buf, int *rrns, int n)
+{
+    Prefetch *pf;
+    int i = 0, count, take, recLen = self->fi.recLen;
+
+    f_acquire(self->pflock);
+    pf = self->prefetch;
+    if (pf == NULL || pf->oper != oper || pf->keyLen != keyLen) {
+        PyThread_release_lock(self->pflock);
+        FILE_IO(self, count, call_fileReadmany(self->fileno, buf, rrns, n, oper, keyLen, 0));
+        return count;
+    }
+    if (!pf->started) {
+        if (PyThread_start_new_thread(f_prefetchRun, pf) == -1) {
+            PyThread_release_lock(self->pflock);
+            return -1;
+        }
+        pf->started = 1;
+    }
+    while (i < n) {
+        if (!pf->held) {
+            f_acquire(pf->full[pf->tail]);
+            pf->held = 1;
+            pf->pos = 0;
+        }
+        count = pf->count[pf->tail];
+        if (count <= 0) {
+            /* the end block is kept, an error is reported when nothing is read */
+            if (count < 0 && i == 0)
+                i = -1;
+            break;
+        }
+        take = count - pf->pos;
+        if (take > n - i)
+            take = n - i;
+        memcpy(buf + (size_t)i * recLen, pf->buf + ((size_t)pf->tail * pf->n + pf->pos) * recLen,
+               (size_t)take * recLen);
+        memcpy(rrns + i, pf->rrns + pf->tail * pf->n + pf->pos, take * sizeof(int));
+        pf->pos += take;
+        i += take;
+        pf->lastRrn = rrns[i - 1];
+        if (pf->pos == count) {
+            PyThread_release_lock(pf->empty[pf->tail]);
+            pf->tail = (pf->tail + 1) % pf->depth;
+            pf->held = 0;
+        }
+    }
+    PyThread_release_lock(self->pflock);
+    return i;
+}
+
 static int
 file400_initFile(File400Object *f);
 
@@ -800,18 +1477,112 @@ convertString(iconv_t cd, char *in, int size)
     return outobj;
 }
 
-/* convert from ebcdic ccsid to utf-8 */
-PyObject *
-ebcdicToString(int fromccsid, char *in, int size)
+/* Single byte ebcdic to unicode table */
+typedef struct sbcsTableStruct {
+    int      ccsid;
+    Py_UCS2  map[256];
+} sbcsTable;
+
+static sbcsTable *sbcs_array[20];
+static int sbcs_size = 0;
+
+/* single byte ccsids converted with a table */
+static int
+f_isSbcs(int ccsid)
 {
-    return convertString(getConvDesc(fromccsid, 1208), in, size);
+    return (ccsid == 37 || ccsid == 273 || ccsid == 277 || ccsid == 278 ||
+            ccsid == 500 || (ccsid >= 1140 && ccsid <= 1148));
 }
 
-/* convert packed to string (ascii) */
-char *
-packedtostr(char *buf, char *p, int digits, int dec, char decsep)
+/* returns table for a single byte ccsid, built with iconv on first use */
+static sbcsTable *
+getSbcsTable(int ccsid)
 {
-    unsigned char c;
+    sbcsTable *t;
+    iconv_t cd;
+    unsigned char in[1], out[8];
+    int i, len;
+    for (i = 0; i < sbcs_size; i++) {
+        if (sbcs_array[i]->ccsid == ccsid)
+            return sbcs_array[i];
+    }
+    if (!f_isSbcs(ccsid) || sbcs_size >= 20)
+        return NULL;
+    cd = getConvDesc(ccsid, 1208);
+    if (cd == (iconv_t)-1)
+        return NULL;
+    t = PyMem_Malloc(sizeof(sbcsTable));
+    if (t == NULL)
+        return NULL;
+    t->ccsid = ccsid;
+    for (i = 0; i < 256; i++) {
+        in[0] = i;
+        len = convertstr(cd, (char *)in, 1, (char *)out, sizeof(out));
+        /* utf-8 to code point, max 3 bytes for single byte ccsids */
+        if (len == 1 && out[0] < 0x80)
+            t->map[i] = out[0];
+        else if (len == 2 && (out[0] & 0xe0) == 0xc0)
+            t->map[i] = ((out[0] & 0x1f) << 6) | (out[1] & 0x3f);
+        else if (len == 3 && (out[0] & 0xf0) == 0xe0)
+            t->map[i] = ((out[0] & 0x0f) << 12) | ((out[1] & 0x3f) << 6) | (out[2] & 0x3f);
+        else {
+            PyMem_Free(t);
+            return NULL;
+        }
+    }
+    sbcs_array[sbcs_size++] = t;
+    return t;
+}
+
+/* convert single byte ebcdic with table, trailing blanks removed if trim */
+static PyObject *
+sbcsToString(sbcsTable *t, unsigned char *in, int size, int trim)
+{
+    PyObject *outobj;
+    Py_UCS2 max = 0;
+    int i;
+    if (trim) {
+        while (size > 0 && in[size - 1] == 0x40)
+            size--;
+    }
+    /* or of all characters tells if the string is ascii or latin-1 */
+    for (i = 0; i < size; i++)
+        max |= t->map[in[i]];
+    if (max < 0x100) {
+        Py_UCS1 *out;
+        outobj = PyUnicode_New(size, (max < 0x80) ? 0x7f : 0xff);
+        if (outobj == NULL)
+            return NULL;
+        out = PyUnicode_1BYTE_DATA(outobj);
+        for (i = 0; i < size; i++)
+            out[i] = (Py_UCS1)t->map[in[i]];
+    } else {
+        Py_UCS2 *out;
+        outobj = PyUnicode_New(size, 0xffff);
+        if (outobj == NULL)
+            return NULL;
+        out = PyUnicode_2BYTE_DATA(outobj);
+        for (i = 0; i < size; i++)
+            out[i] = t->map[in[i]];
+    }
+    return outobj;
+}
+
+/* convert from ebcdic ccsid to utf-8 */
+PyObject *
+ebcdicToString(int fromccsid, char *in, int size)
+{
+    sbcsTable *t = getSbcsTable(fromccsid);
+    if (t != NULL)
+        return sbcsToString(t, (unsigned char *)in, size, 0);
+    return convertString(getConvDesc(fromccsid, 1208), in, size);
+}
+
+/* convert packed to string (ascii) */
+char *
+packedtostr(char *buf, char *p, int digits, int dec, char decsep)
+{
+    unsigned char c;
     int decstart, i, j;
     /* size should be odd */
     if ((digits % 2) == 0)
@@ -819,7 +1590,8 @@ packedtostr(char *buf, char *p, int digits, int dec, char decsep)
     decstart = digits - dec;
     /* check if negative */
     j = 0;
-    if ((p[digits/2] | 0xF0) != 0xFF) {
+    c = p[digits/2] & 0x0F;
+    if (c == 0x0D || c == 0x0B) {
         buf[j] = '-';
         j++;
     }
@@ -860,7 +1632,8 @@ zonedtostr(char *buf, char *p, int digits, int dec, char decsep)
     decstart = digits - dec;
     /* check if negative */
     j = 0;
-    if (((p[digits - 1] >> 4) | 0xF0) != 0xFF) {
+    c = (p[digits - 1] >> 4) & 0x0F;
+    if (c == 0x0D || c == 0x0B) {
         buf[j] = '-';
         j++;
     }
@@ -889,20 +1662,114 @@ zonedtostr(char *buf, char *p, int digits, int dec, char decsep)
     return buf;
 }
 
-/* convert field to Python format */
+/* convert packed to long long, max 18 digits */
+static long long
+packedtoll(unsigned char *p, int digits)
+{
+    long long val = 0;
+    int i, n;
+    unsigned char s;
+    /* number of bytes before the byte with the last digit and sign */
+    n = digits / 2;
+    /* four digits at a time */
+    for (i = 0; i + 1 < n; i += 2)
+        val = val * 10000 + packedDigits[p[i]] * 100 + packedDigits[p[i + 1]];
+    if (i < n)
+        val = val * 100 + packedDigits[p[i]];
+    s = p[n];
+    val = val * 10 + (s >> 4);
+    /* 0x0D and 0x0B are negative, all other signs positive */
+    s &= 0x0f;
+    if (s == 0x0d || s == 0x0b)
+        return -val;
+    return val;
+}
+
+/* convert zoned to long long, max 18 digits */
+static long long
+zonedtoll(unsigned char *p, int digits)
+{
+    long long val = 0;
+    int i;
+    unsigned char s;
+    /* two digits at a time */
+    for (i = 0; i + 1 < digits; i += 2)
+        val = val * 100 + (p[i] & 0x0f) * 10 + (p[i + 1] & 0x0f);
+    if (i < digits)
+        val = val * 10 + (p[i] & 0x0f);
+    /* sign is in the zone of the last digit */
+    s = p[digits - 1] >> 4;
+    if (s == 0x0d || s == 0x0b)
+        return -val;
+    return val;
+}
+
+/* get decimal.Decimal, imported on first use */
+static PyObject *
+f_decimalType(void)
+{
+    PyObject *mod;
+    if (decimalType == NULL) {
+        mod = PyImport_ImportModule("decimal");
+        if (mod == NULL)
+            return NULL;
+        decimalType = PyObject_GetAttrString(mod, "Decimal");
+        Py_DECREF(mod);
+    }
+    return decimalType;
+}
+
+/* convert packed or zoned to Decimal, built from the digit tuple */
+static PyObject *
+f_decToDecimal(unsigned char *p, fieldInfoStruct *field)
+{
+    unsigned char d[64], s;
+    int i, k, n, first, neg;
+    PyObject *cls, *digits, *args, *res;
+
+    if ((cls = f_decimalType()) == NULL)
+        return NULL;
+    n = field->digits;
+    if (field->type == 3) {
+        /* first digit nibble, an even number of digits has a pad nibble */
+        k = (n % 2) ? 0 : 1;
+        for (i = 0; i < n; i++, k++)
+            d[i] = (k % 2) ? (p[k / 2] & 0x0f) : (p[k / 2] >> 4);
+        s = p[n / 2] & 0x0f;
+    } else {
+        for (i = 0; i < n; i++)
+            d[i] = p[i] & 0x0f;
+        s = p[n - 1] >> 4;
+    }
+    neg = (s == 0x0d || s == 0x0b);
+    /* skip leading zeros, but keep one digit */
+    for (first = 0; first < n - 1 && d[first] == 0; first++)
+        ;
+    digits = PyTuple_New(n - first);
+    if (digits == NULL)
+        return NULL;
+    for (i = first; i < n; i++)
+        PyTuple_SET_ITEM(digits, i - first, PyLong_FromLong(d[i]));
+    args = Py_BuildValue("((iNi))", neg, digits, -field->dec);
+    if (args == NULL)
+        return NULL;
+    res = PyObject_Call(cls, args, NULL);
+    Py_DECREF(args);
+    return res;
+}
+
+/* convert field at p to Python format */
 static PyObject *
-f_cvtToPy(char * fb, fieldInfoStruct *field)
+f_cvtToPy(char * p, fieldInfoStruct *field, int decimal)
 {
     short dsh, varlen;
     char buf[100], *ss;
-    char *p;
     int dl;
     int len;
     long long dll;
     float dfl;
     double ddbl;
 
-    p = fb + field->offset;
     len = field->len;
     switch (field->type) {
     /* binary */
@@ -935,6 +1802,16 @@ f_cvtToPy(char * fb, fieldInfoStruct *field)
         }
     /* zoned */
     case 2:
+        if (decimal && field->dec > 0)
+            return f_decToDecimal((unsigned char *)p, field);
+        /* decode directly if the value fits, a double is exact up to 15 digits */
+        if (field->digits <= 18) {
+            dll = zonedtoll((unsigned char *)p, field->digits);
+            if (field->dec == 0)
+                return PyLong_FromLongLong(dll);
+            if (field->digits <= 15)
+                return PyFloat_FromDouble((double)dll / dblPow10[field->dec]);
+        }
         zonedtostr((char *)buf, p, field->digits, field->dec, '.');
         if (field->dec == 0)
             return PyLong_FromLongLong(strtoll((char *)buf, &ss, 10));
@@ -942,6 +1819,15 @@ f_cvtToPy(char * fb, fieldInfoStruct *field)
             return PyFloat_FromDouble(strtod((char *)buf, &ss));
     /* packed */
     case 3:
+        if (decimal && field->dec > 0)
+            return f_decToDecimal((unsigned char *)p, field);
+        if (field->digits <= 18) {
+            dll = packedtoll((unsigned char *)p, field->digits);
+            if (field->dec == 0)
+                return PyLong_FromLongLong(dll);
+            if (field->digits <= 15)
+                return PyFloat_FromDouble((double)dll / dblPow10[field->dec]);
+        }
         packedtostr((char *)buf, p, field->digits, field->dec, '.');
         if (field->dec == 0)
             return PyLong_FromLongLong(strtoll((char *)buf, &ss, 10));
@@ -994,6 +1880,215 @@ f_cvtToPy(char * fb, fieldInfoStruct *field)
     }
 }
 
+/*
+ * get python number as an unsigned value scaled by dec and truncated,
+ * frac gets the part cut off, 0 none, 1 less than half, 2 half or more.
+ * returns 1 if the value needs more than 128 bits, -1 if not valid
+ */
+static int
+f_pyToScaledTrunc(PyObject *o, int dec, unsigned __int128 *uval, int *neg, int *frac)
+{
+    unsigned __int128 u = 0;
+    long long ll;
+    long exp, keep, i;
+    double d, f;
+    int digit, first = 0, sticky = 0, overflow;
+
+    *frac = 0;
+    if (PyLong_Check(o)) {
+        ll = PyLong_AsLongLongAndOverflow(o, &overflow);
+        if (!overflow) {
+            if (ll == -1 && PyErr_Occurred())
+                return -1;
+            *neg = (ll < 0);
+            u = (*neg) ? -(unsigned long long)ll : (unsigned long long)ll;
+        } else {
+            /* more than 64 bits, split absolute value in two halves */
+            PyObject *abs, *shift, *hi;
+            unsigned long long uhi;
+            *neg = (overflow < 0);
+            abs = PyNumber_Absolute(o);
+            if (abs == NULL)
+                return -1;
+            shift = PyLong_FromLong(64);
+            hi = PyNumber_Rshift(abs, shift);
+            Py_DECREF(shift);
+            uhi = (hi != NULL) ? PyLong_AsUnsignedLongLong(hi) : (unsigned long long)-1;
+            Py_XDECREF(hi);
+            if (PyErr_Occurred()) {
+                Py_DECREF(abs);
+                PyErr_Clear();
+                return 1;
+            }
+            u = ((unsigned __int128)uhi << 64) | PyLong_AsUnsignedLongLongMask(abs);
+            Py_DECREF(abs);
+        }
+        for (i = 0; i < dec; i++) {
+            if (u > ((unsigned __int128)-1) / 10)
+                return 1;
+            u *= 10;
+        }
+    } else if (PyFloat_Check(o)) {
+        d = PyFloat_AS_DOUBLE(o);
+        if (isnan(d)) {
+            PyErr_SetString(file400Error, "Data conversion error.");
+            return -1;
+        }
+        *neg = (d < 0);
+        if (*neg)
+            d = -d;
+        d *= (dec <= 22) ? dblPow10[dec] : pow(10, dec);
+        f = floor(d);
+        if (!(f < 340282366920938463463374607431768211456.0))
+            return 1;
+        u = (unsigned __int128)f;
+        d -= f;
+        *frac = (d == 0) ? 0 : (d < 0.5) ? 1 : 2;
+    } else if (f_decimalType() != NULL && PyObject_IsInstance(o, decimalType) == 1) {
+        /* Decimal, from the digit tuple so the context precision does not round it */
+        PyObject *t, *digits;
+        t = PyObject_CallMethod(o, "as_tuple", NULL);
+        if (t == NULL)
+            return -1;
+        if (!PyLong_Check(PyTuple_GET_ITEM(t, 2))) {
+            /* infinity or NaN */
+            Py_DECREF(t);
+            PyErr_SetString(file400Error, "Data conversion error.");
+            return -1;
+        }
+        *neg = (PyLong_AsLong(PyTuple_GET_ITEM(t, 0)) != 0);
+        digits = PyTuple_GET_ITEM(t, 1);
+        exp = PyLong_AsLong(PyTuple_GET_ITEM(t, 2)) + dec;
+        /* digits before the point after scaling, the rest are cut off */
+        keep = PyTuple_GET_SIZE(digits) + ((exp < 0) ? exp : 0);
+        for (i = 0; i < PyTuple_GET_SIZE(digits); i++) {
+            digit = PyLong_AsLong(PyTuple_GET_ITEM(digits, i));
+            if (i < keep) {
+                if (u > ((unsigned __int128)-1 - digit) / 10) {
+                    Py_DECREF(t);
+                    return 1;
+                }
+                u = u * 10 + digit;
+            } else if (i == keep)
+                first = digit;
+            else
+                sticky |= digit;
+        }
+        Py_DECREF(t);
+        for (; exp > 0 && u != 0; exp--) {
+            if (u > ((unsigned __int128)-1) / 10)
+                return 1;
+            u *= 10;
+        }
+        *frac = (first >= 5) ? 2 : (first != 0 || sticky != 0) ? 1 : 0;
+    } else {
+        PyErr_SetString(file400Error, "Data conversion error.");
+        return -1;
+    }
+    *uval = u;
+    return 0;
+}
+
+/* get python number as an unsigned value scaled by dec, rounded half away from zero */
+static int
+f_pyToScaled(PyObject *o, int dec, unsigned __int128 *uval, int *neg)
+{
+    int rc, frac;
+
+    rc = f_pyToScaledTrunc(o, dec, uval, neg, &frac);
+    if (rc < 0)
+        return -1;
+    if (rc == 0 && frac == 2) {
+        if (*uval == (unsigned __int128)-1)
+            rc = 1;
+        else
+            (*uval)++;
+    }
+    if (rc > 0) {
+        PyErr_SetString(file400Error, "Value does not fit in field.");
+        return -1;
+    }
+    /* no negative zero sign for a value that rounds to 0 */
+    if (*uval == 0)
+        *neg = 0;
+    return 0;
+}
+
+/* put unsigned value into packed field, returns -1 if it doesn't fit */
+static int
+u128topacked(unsigned char *p, int digits, unsigned __int128 u, int neg)
+{
+    unsigned long long u64;
+    int i, n;
+    n = digits / 2;
+    /* last digit and sign */
+    p[n] = ((unsigned char)(u % 10) << 4) | (neg ? 0x0d : 0x0f);
+    u /= 10;
+    /* 128 bit arithmetic only while the value needs it */
+    for (i = n - 1; i >= 0 && (u >> 64) != 0; i--) {
+        p[i] = bcdBytes[(int)(u % 100)];
+        u /= 100;
+    }
+    if ((u >> 64) != 0)
+        return -1;
+    u64 = (unsigned long long)u;
+    for (; i >= 0; i--) {
+        p[i] = bcdBytes[u64 % 100];
+        u64 /= 100;
+    }
+    /* even number of digits has an unused first nibble */
+    if (u64 != 0 || ((digits % 2) == 0 && (p[0] >> 4) != 0))
+        return -1;
+    return 0;
+}
+
+/* put unsigned value into zoned field, returns -1 if it doesn't fit */
+static int
+u128tozoned(unsigned char *p, int digits, unsigned __int128 u, int neg)
+{
+    unsigned long long u64;
+    int i;
+    for (i = digits - 1; i >= 0 && (u >> 64) != 0; i--) {
+        p[i] = 0xf0 | (unsigned char)(u % 10);
+        u /= 10;
+    }
+    if ((u >> 64) != 0)
+        return -1;
+    u64 = (unsigned long long)u;
+    for (; i >= 0; i--) {
+        p[i] = 0xf0 | (unsigned char)(u64 % 10);
+        u64 /= 10;
+    }
+    if (u64 != 0)
+        return -1;
+    /* sign is in the zone of the last digit */
+    if (neg)
+        p[digits - 1] = (p[digits - 1] & 0x0f) | 0xd0;
+    return 0;
+}
+
+/* convert python number to packed or zoned field */
+static int
+f_cvtToDec(char *p, fieldInfoStruct *field, PyObject *o)
+{
+    unsigned char buf[64];
+    unsigned __int128 u;
+    int neg, rc;
+    if (f_pyToScaled(o, field->dec, &u, &neg) < 0)
+        return -1;
+    /* convert into work buffer, so the field is unchanged if the value doesn't fit */
+    if (field->type == 3)
+        rc = u128topacked(buf, field->digits, u, neg);
+    else
+        rc = u128tozoned(buf, field->digits, u, neg);
+    if (rc < 0) {
+        PyErr_SetString(file400Error, "Value does not fit in field.");
+        return -1;
+    }
+    memcpy(p, buf, field->len);
+    return 0;
+}
+
 /* convert field from Python format */
 static int
 f_cvtFromPy(char *fb, fieldInfoStruct *field, PyObject *o)
@@ -1005,7 +2100,7 @@ f_cvtFromPy(char *fb, fieldInfoStruct *field, PyObject *o)
     double ddbl;
     char *c;
     char *p;
-    int len, i, digits, dec;
+    int len, i;
     Py_ssize_t si;
 
     p = fb + field->offset;
@@ -1055,38 +2150,11 @@ f_cvtFromPy(char *fb, fieldInfoStruct *field, PyObject *o)
             memcpy(p, &ddbl, len);
             break;
         }
-    /* zoned */
-    case 2:
-        digits = field->digits;
-        dec = field->dec;
-        if (PyLong_Check(o)) {
-            if ((digits - dec) < 10)
-                call_int2zoned(p, digits, dec, PyLong_AsLong(o));
-            else
-                call_float2zoned(p, digits, dec, PyLong_AsDouble(o));
-            break;
-        } else if (PyFloat_Check(o)) {
-            call_float2zoned(p, digits, dec, PyFloat_AS_DOUBLE(o));
-            break;
-        }
-        PyErr_SetString(file400Error, "Data conversion error.");
-        return -1;
-    /* packed */
-    case 3:
-        digits = field->digits;
-        dec = field->dec;
-        if (PyLong_Check(o)) {
-            if ((digits - dec) < 10)
-                call_int2packed(p, digits, dec, PyLong_AsLong(o));
-            else
-                call_float2packed(p, digits, dec, PyLong_AsDouble(o));
-            break;
-        } else if (PyFloat_Check(o)) {
-            call_float2packed(p, digits, dec, PyFloat_AS_DOUBLE(o));
-            break;
-        }
-        PyErr_SetString(file400Error, "Data conversion error.");
-        return -1;
+    /* zoned, packed */
+    case 2: case 3:
+        if (f_cvtToDec(p, field, o) < 0)
+            return -1;
+        break;
     /* char, date, time, timestamp */
     case 4: case 11: case 12: case 13:
         if (PyBytes_Check(o) || PyUnicode_Check(o)) {
@@ -1273,134 +2341,490 @@ f_clear(File400Object *file, char *record)
     return 0;
 }
 
-/* internal routine to get field value from record */
+/* field converters used by the decode plan */
 static PyObject *
-f_getFieldValue(File400Object *self, int pos, char *p)
+cvt_bin2(char *rec, fieldPlan *fp)
 {
-    return f_cvtToPy(p, &self->fieldArr[pos]);
+    short dsh;
+    memcpy(&dsh, rec + fp->offset, 2);
+    return PyLong_FromLong(dsh);
 }
 
-/* internal routine to set field value */
-static int
-f_setFieldValue(File400Object *self, int pos, PyObject *o, char *p)
+static PyObject *
+cvt_bin4(char *rec, fieldPlan *fp)
 {
-    if (self->fi.omode == OPEN_WRITE)
-        return f_cvtFromPy(p, &self->fieldArr[pos], o);
-    else
-        return f_cvtFromPy(p, &self->fieldArr[pos], o);
+    int dl;
+    memcpy(&dl, rec + fp->offset, 4);
+    return PyLong_FromLong(dl);
 }
 
-/* internal routine to get field position */
-static int
-f_getFieldPos(File400Object *self, PyObject *field)
+static PyObject *
+cvt_bin8(char *rec, fieldPlan *fp)
 {
-    PyObject *posO;
-    int i = -1;
+    long long dll;
+    memcpy(&dll, rec + fp->offset, 8);
+    return PyLong_FromLongLong(dll);
+}
 
-    Py_INCREF(field);
-    if (PyLong_Check(field)) {
-        i = PyLong_AS_LONG(field);
-        if (i >= self->fi.fieldCount)
-            i = -1;
-    } else if (PyUnicode_Check(field)) {
-        /* convert to upper, first check */
-        posO = PyDict_GetItem(self->fieldDict, field);
-        if (posO != NULL)
-            i = PyLong_AS_LONG(posO);
-    }
-    Py_DECREF(field);
-    return i;
+static PyObject *
+cvt_float4(char *rec, fieldPlan *fp)
+{
+    float dfl;
+    memcpy(&dfl, rec + fp->offset, 4);
+    return PyFloat_FromDouble((double)dfl);
 }
 
-/* check if file is initialized */
-static int
-f_initialize(File400Object *self)
+static PyObject *
+cvt_float8(char *rec, fieldPlan *fp)
 {
-    if (self->fieldArr == NULL) {
-        if (file400_initFile(self) < 0) {
-            return 0;
-        }
-    }
-    return 1;
+    double ddbl;
+    memcpy(&ddbl, rec + fp->offset, 8);
+    return PyFloat_FromDouble(ddbl);
 }
 
-/* check if file is open */
-static int
-f_isOpen(File400Object *self)
+static PyObject *
+cvt_zonedInt(char *rec, fieldPlan *fp)
 {
-    if (self->fieldArr == NULL) {
-        if (file400_initFile(self) < 0) {
-            return 0;
-        }
-    }
-    return 1;
+    return PyLong_FromLongLong(zonedtoll((unsigned char *)rec + fp->offset, fp->digits));
 }
 
-/* get key length and update key buffer */
-static int
-f_keylen(File400Object *self, PyObject *key, char *keyval)
+static PyObject *
+cvt_zonedFloat(char *rec, fieldPlan *fp)
 {
-    int i, keyLen, keyCnt;
-    /* The key can be None (all keys) */
-    /* or an integer with number of keys to search */
-    if (keyval == NULL && PyLong_Check(key)) {
-        /* find key length */
-        keyCnt = PyLong_AS_LONG(key);
-        if (keyCnt < 0 || keyCnt > self->fi.keyCount) {
-            PyErr_SetString(file400Error, "Number of key fields not valid.");
-            return -1;
-        }
-        keyLen = 0;
-        for (i = 0; i < keyCnt; i++)
-            keyLen += self->keyArr[i].len;
-    } else if (keyval != NULL && PySequence_Check(key)) {
-        PyObject *ko;
-        /* check number of key fields */
-        keyCnt = PySequence_Length(key);
-        if (keyCnt > self->fi.keyCount) {
-            PyErr_SetString(file400Error, "Too many key fields.");
-            return -1;
-        }
-        /* put key values  */
-        keyLen = 0;
-        for (i = 0; i < keyCnt; i++) {
-            ko = PySequence_GetItem(key, i);
-            if (f_cvtFromPy(keyval, &self->keyArr[i], ko) < 0)
-                return -1;
-            Py_DECREF(ko);
-            keyLen += self->keyArr[i].len;
-        }
-    } else {
-        PyErr_SetString(file400Error, "Key not valid.");
-        return -1;
-    }
-    return keyLen;
+    return PyFloat_FromDouble((double)zonedtoll((unsigned char *)rec + fp->offset, fp->digits)
+                              / dblPow10[fp->dec]);
 }
 
-/* creates object from class or type */
 static PyObject *
-f_createObject(PyObject *cls)
+cvt_packedInt(char *rec, fieldPlan *fp)
 {
-    PyObject *obj, *args, *kwds;
-    args = PyTuple_New(0);
-    kwds = PyDict_New();
-    obj = ((PyTypeObject *)cls)->tp_new((PyTypeObject *)cls, args, kwds);
-    Py_DECREF(args);
-    Py_DECREF(kwds);
-    return obj;
+    return PyLong_FromLongLong(packedtoll((unsigned char *)rec + fp->offset, fp->digits));
 }
 
-/* File400 methods */
+static PyObject *
+cvt_packedFloat(char *rec, fieldPlan *fp)
+{
+    return PyFloat_FromDouble((double)packedtoll((unsigned char *)rec + fp->offset, fp->digits)
+                              / dblPow10[fp->dec]);
+}
 
-static void
-File400_dealloc(File400Object *self)
+static PyObject *
+cvt_decimal(char *rec, fieldPlan *fp)
 {
+    return f_decToDecimal((unsigned char *)rec + fp->offset, fp->field);
+}
+
+static PyObject *
+cvt_utf8(char *rec, fieldPlan *fp)
+{
+    char *p = rec + fp->offset;
+    return PyUnicode_FromStringAndSize(p, f_utflen(p, fp->len));
+}
+
+static PyObject *
+cvt_bytes(char *rec, fieldPlan *fp)
+{
+    return PyBytes_FromStringAndSize(rec + fp->offset, fp->len);
+}
+
+static PyObject *
+cvt_sbcs(char *rec, fieldPlan *fp)
+{
+    return sbcsToString(fp->sbcs, (unsigned char *)rec + fp->offset, fp->len, 1);
+}
+
+static PyObject *
+cvt_sbcsNoTrim(char *rec, fieldPlan *fp)
+{
+    return sbcsToString(fp->sbcs, (unsigned char *)rec + fp->offset, fp->len, 0);
+}
+
+static PyObject *
+cvt_varSbcs(char *rec, fieldPlan *fp)
+{
+    short varlen;
+    unsigned char *p = (unsigned char *)rec + fp->offset;
+    memcpy(&varlen, p, sizeof(short));
+    return sbcsToString(fp->sbcs, p + sizeof(short), varlen, 1);
+}
+
+static PyObject *
+cvt_ebcdic(char *rec, fieldPlan *fp)
+{
+    char *p = rec + fp->offset;
+    return convertString(fp->cd, p, f_strlen(p, fp->len));
+}
+
+static PyObject *
+cvt_ebcdicNoTrim(char *rec, fieldPlan *fp)
+{
+    return convertString(fp->cd, rec + fp->offset, fp->len);
+}
+
+static PyObject *
+cvt_ascii(char *rec, fieldPlan *fp)
+{
+    return PyUnicode_FromStringAndSize(rec + fp->offset, fp->len);
+}
+
+static PyObject *
+cvt_varEbcdic(char *rec, fieldPlan *fp)
+{
+    short varlen;
+    char *p = rec + fp->offset;
+    memcpy(&varlen, p, sizeof(short));
+    p += sizeof(short);
+    return convertString(fp->cd, p, f_strlen(p, varlen));
+}
+
+static PyObject *
+cvt_varUtf8(char *rec, fieldPlan *fp)
+{
+    short varlen;
+    char *p = rec + fp->offset;
+    memcpy(&varlen, p, sizeof(short));
+    p += sizeof(short);
+    return PyUnicode_FromStringAndSize(p, f_utflen(p, varlen));
+}
+
+static PyObject *
+cvt_varBytes(char *rec, fieldPlan *fp)
+{
+    short varlen;
+    char *p = rec + fp->offset;
+    memcpy(&varlen, p, sizeof(short));
+    return PyBytes_FromStringAndSize(p + sizeof(short), varlen);
+}
+
+static PyObject *
+cvt_utf16(char *rec, fieldPlan *fp)
+{
+    char *p = rec + fp->offset;
+    return PyUnicode_DecodeUTF16(p, f_unilen(p, fp->len), "", 0);
+}
+
+/* all other types */
+static PyObject *
+cvt_generic(char *rec, fieldPlan *fp)
+{
+    /* the plan offset can be moved from the field offset */
+    return f_cvtToPy(rec + fp->offset, fp->field, 0);
+}
+
+/* string from the field cache, converted and added if not found */
+static PyObject *
+cvt_cached(char *rec, fieldPlan *fp)
+{
+    strCache *c = fp->cache;
+    unsigned char *p = (unsigned char *)rec + fp->offset;
+    unsigned int h = 2166136261u;
+    int i, slot;
+    PyObject *o;
+    /* fnv-1a hash of the raw value */
+    for (i = 0; i < fp->len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    slot = h & (STRCACHE_SIZE - 1);
+    for (i = 0; i < STRCACHE_SIZE; i++) {
+        if (c->obj[slot] == NULL)
+            break;
+        if (!memcmp(c->keys + slot * fp->len, p, fp->len)) {
+            Py_INCREF(c->obj[slot]);
+            return c->obj[slot];
+        }
+        slot = (slot + 1) & (STRCACHE_SIZE - 1);
+    }
+    o = fp->base(rec, fp);
+    if (o == NULL)
+        return NULL;
+    /* keep a quarter of the slots free to keep probing short */
+    if (c->count < STRCACHE_SIZE * 3 / 4) {
+        memcpy(c->keys + slot * fp->len, p, fp->len);
+        Py_INCREF(o);
+        c->obj[slot] = o;
+        c->count++;
+    } else if (c->automatic && ++c->misses > STRCACHE_MISSES) {
+        /* too many distinct values, stop using the cache */
+        fp->cvt = fp->base;
+    }
+    return o;
+}
+
+/* put a string cache in front of the field converter, none if out of memory */
+static void
+f_planCache(fieldPlan *fp, int automatic)
+{
+    strCache *c;
+    c = PyMem_Malloc(sizeof(strCache));
+    if (c == NULL)
+        return;
+    memset(c, 0, sizeof(strCache));
+    c->automatic = automatic;
+    c->keys = PyMem_Malloc(STRCACHE_SIZE * fp->len);
+    if (c->keys == NULL) {
+        PyMem_Free(c);
+        return;
+    }
+    fp->cache = c;
+    fp->base = fp->cvt;
+    fp->cvt = cvt_cached;
+}
+
+/* free the decode plan and the string caches */
+static void
+f_freePlan(File400Object *self)
+{
+    int i, j;
+    strCache *c;
+    if (self->plan == NULL)
+        return;
+    for (i = 0; i < self->fi.fieldCount; i++) {
+        c = self->plan[i].cache;
+        if (c != NULL) {
+            for (j = 0; j < STRCACHE_SIZE; j++)
+                Py_XDECREF(c->obj[j]);
+            PyMem_Free(c->keys);
+            PyMem_Free(c);
+        }
+    }
+    PyMem_Free(self->plan);
+    self->plan = NULL;
+}
+
+/* resolve converter, width and conversion descriptor for a field */
+static void
+f_planField(fieldPlan *fp, fieldInfoStruct *field, int decimal)
+{
+    fp->cvt = cvt_generic;
+    fp->offset = field->offset;
+    fp->len = field->len;
+    fp->digits = field->digits;
+    fp->dec = field->dec;
+    fp->cd = (iconv_t)-1;
+    fp->sbcs = NULL;
+    fp->base = NULL;
+    fp->cache = NULL;
+    fp->field = field;
+    switch (field->type) {
+    /* binary */
+    case 0:
+        if (fp->len == 2)
+            fp->cvt = cvt_bin2;
+        else if (fp->len == 4)
+            fp->cvt = cvt_bin4;
+        else if (fp->len == 8)
+            fp->cvt = cvt_bin8;
+        break;
+    /* float */
+    case 1:
+        if (fp->len == 4)
+            fp->cvt = cvt_float4;
+        else if (fp->len == 8)
+            fp->cvt = cvt_float8;
+        break;
+    /* zoned */
+    case 2:
+        if (decimal && fp->dec > 0)
+            fp->cvt = cvt_decimal;
+        else if (fp->digits <= 18 && fp->dec == 0)
+            fp->cvt = cvt_zonedInt;
+        else if (fp->digits <= 15)
+            fp->cvt = cvt_zonedFloat;
+        break;
+    /* packed */
+    case 3:
+        if (decimal && fp->dec > 0)
+            fp->cvt = cvt_decimal;
+        else if (fp->digits <= 18 && fp->dec == 0)
+            fp->cvt = cvt_packedInt;
+        else if (fp->digits <= 15)
+            fp->cvt = cvt_packedFloat;
+        break;
+    /* char */
+    case 4:
+        if (field->ccsid == 1208)
+            fp->cvt = cvt_utf8;
+        else if (field->ccsid == 65535)
+            fp->cvt = cvt_bytes;
+        else if ((fp->sbcs = getSbcsTable(field->ccsid)) != NULL)
+            fp->cvt = cvt_sbcs;
+        else {
+            fp->cd = getConvDesc(field->ccsid, 1208);
+            fp->cvt = cvt_ebcdic;
+        }
+        break;
+    /* graphic (unicode) */
+    case 5:
+        if (field->ccsid == 1200)
+            fp->cvt = cvt_utf16;
+        break;
+    /* date, time, timestamp */
+    case 11: case 12: case 13:
+        if (field->ccsid == 65535 || field->ccsid == 1208)
+            fp->cvt = cvt_ascii;
+        else if ((fp->sbcs = getSbcsTable(field->ccsid)) != NULL)
+            fp->cvt = cvt_sbcsNoTrim;
+        else {
+            fp->cd = getConvDesc(field->ccsid, 1208);
+            fp->cvt = cvt_ebcdicNoTrim;
+        }
+        break;
+    /* varchar */
+    case 0x8004:
+        if (field->ccsid == 1208)
+            fp->cvt = cvt_varUtf8;
+        else if (field->ccsid == 65535)
+            fp->cvt = cvt_varBytes;
+        else if ((fp->sbcs = getSbcsTable(field->ccsid)) != NULL)
+            fp->cvt = cvt_varSbcs;
+        else {
+            fp->cd = getConvDesc(field->ccsid, 1208);
+            fp->cvt = cvt_varEbcdic;
+        }
+        break;
+    }
+}
+
+/* internal routine to get field value from record */
+static PyObject *
+f_getFieldValue(File400Object *self, int pos, char *p)
+{
+    return self->plan[pos].cvt(p, &self->plan[pos]);
+}
+
+/* internal routine to set field value */
+static int
+f_setFieldValue(File400Object *self, int pos, PyObject *o, char *p)
+{
+    if (self->fi.omode == OPEN_WRITE)
+        return f_cvtFromPy(p, &self->fieldArr[pos], o);
+    else
+        return f_cvtFromPy(p, &self->fieldArr[pos], o);
+}
+
+/* internal routine to get field position */
+static int
+f_getFieldPos(File400Object *self, PyObject *field)
+{
+    PyObject *posO;
+    int i = -1;
+
+    Py_INCREF(field);
+    if (PyLong_Check(field)) {
+        i = PyLong_AS_LONG(field);
+        if (i >= self->fi.fieldCount)
+            i = -1;
+    } else if (PyUnicode_Check(field)) {
+        /* convert to upper, first check */
+        posO = PyDict_GetItem(self->fieldDict, field);
+        if (posO != NULL)
+            i = PyLong_AS_LONG(posO);
+    }
+    Py_DECREF(field);
+    return i;
+}
+
+/* check if file is initialized */
+static int
+f_initialize(File400Object *self)
+{
+    if (self->recbuf == NULL) {
+        if (file400_initFile(self) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* check if file is open */
+static int
+f_isOpen(File400Object *self)
+{
+    /* the record buffer is set last by the initialization */
+    if (self->recbuf == NULL) {
+        if (file400_initFile(self) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* get key length and update key buffer */
+static int
+f_keylen(File400Object *self, PyObject *key, char *keyval)
+{
+    int i, keyLen, keyCnt;
+    /* The key can be None (all keys) */
+    /* or an integer with number of keys to search */
+    if (keyval == NULL && PyLong_Check(key)) {
+        /* find key length */
+        keyCnt = PyLong_AS_LONG(key);
+        if (keyCnt < 0 || keyCnt > self->fi.keyCount) {
+            PyErr_SetString(file400Error, "Number of key fields not valid.");
+            return -1;
+        }
+        keyLen = 0;
+        for (i = 0; i < keyCnt; i++)
+            keyLen += self->keyArr[i].len;
+    } else if (keyval != NULL && PySequence_Check(key)) {
+        PyObject *ko;
+        /* check number of key fields */
+        keyCnt = PySequence_Length(key);
+        if (keyCnt > self->fi.keyCount) {
+            PyErr_SetString(file400Error, "Too many key fields.");
+            return -1;
+        }
+        /* put key values  */
+        keyLen = 0;
+        for (i = 0; i < keyCnt; i++) {
+            ko = PySequence_GetItem(key, i);
+            if (f_cvtFromPy(keyval, &self->keyArr[i], ko) < 0)
+                return -1;
+            Py_DECREF(ko);
+            keyLen += self->keyArr[i].len;
+        }
+    } else {
+        PyErr_SetString(file400Error, "Key not valid.");
+        return -1;
+    }
+    return keyLen;
+}
+
+/* creates object from class or type */
+static PyObject *
+f_createObject(PyObject *cls)
+{
+    PyObject *obj, *args, *kwds;
+    args = PyTuple_New(0);
+    kwds = PyDict_New();
+    obj = ((PyTypeObject *)cls)->tp_new((PyTypeObject *)cls, args, kwds);
+    Py_DECREF(args);
+    Py_DECREF(kwds);
+    return obj;
+}
+
+/* File400 methods */
+
+static void
+File400_dealloc(File400Object *self)
+{
+    f_prefetchStop(self, 0);
+    /* hold the lock while the buffers and the handle are freed, as close */
+    if (self->lock) f_lock(self);
     if (self->recbuf) PyMem_Free(self->recbuf);
     if (self->fieldArr) PyMem_Free(self->fieldArr);
     if (self->keyArr) PyMem_Free(self->keyArr);
+    if (self->decArr) PyMem_Free(self->decArr);
+    f_freePlan(self);
     Py_XDECREF(self->fieldDict);
     Py_XDECREF(self->keyDict);
+    Py_XDECREF(self->decimal);
+    Py_XDECREF(self->cache);
     call_fileFree(self->fileno);
+    if (self->lock) {
+        PyThread_release_lock(self->lock);
+        PyThread_free_lock(self->lock);
+    }
+    if (self->pflock) PyThread_free_lock(self->pflock);
     PyObject_Del(self);
 }
 
@@ -1431,22 +2855,40 @@ Close the file.";
 static PyObject *
 File400_close(File400Object *self, PyObject *args)
 {
+    int result = -1;
     if (!PyArg_ParseTuple(args, ":close"))
         return NULL;
-    if (self->fieldArr == NULL || call_fileFree(self->fileno) < 0) {
+    if (self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "Record buffer is in use by a memoryview.");
+        return NULL;
+    }
+    f_prefetchStop(self, 0);
+    /* hold the lock while the buffers are freed */
+    f_lock(self);
+    if (self->fieldArr != NULL) {
+        Py_BEGIN_ALLOW_THREADS
+        result = call_fileFree(self->fileno);
+        Py_END_ALLOW_THREADS
+    }
+    if (result < 0) {
+        PyThread_release_lock(self->lock);
         PyErr_SetString(file400Error, "Error closing file.");
         return NULL;
     }
     if (self->recbuf) PyMem_Free(self->recbuf);
     if (self->fieldArr) PyMem_Free(self->fieldArr);
     if (self->keyArr) PyMem_Free(self->keyArr);
+    if (self->decArr) PyMem_Free(self->decArr);
+    f_freePlan(self);
     Py_XDECREF(self->fieldDict);
     Py_XDECREF(self->keyDict);
     self->recbuf = NULL;
     self->fieldArr = NULL;
     self->keyArr = NULL;
+    self->decArr = NULL;
     self->fieldDict = NULL;
     self->keyDict = NULL;
+    PyThread_release_lock(self->lock);
     Py_INCREF(Py_None);
     return Py_None;
 }
@@ -1477,7 +2919,8 @@ File400_posb(File400Object *self, PyObject *args, PyObject *keywds)
         PyMem_Free(keybuf);
         return NULL;
     }
-    result = call_filePosb(self->fileno, keybuf, keyLen, lock);
+    f_prefetchStop(self, 0);
+    FILE_IO(self, result, call_filePosb(self->fileno, keybuf, keyLen, lock));
     PyMem_Free(keybuf);
     if (result == -1) {
         PyErr_SetString(file400Error, "posb failed.");
@@ -1512,7 +2955,8 @@ File400_posa(File400Object *self, PyObject *args, PyObject *keywds)
         PyMem_Free(keybuf);
         return NULL;
     }
-    result = call_filePosa(self->fileno, keybuf, keyLen, lock);
+    f_prefetchStop(self, 0);
+    FILE_IO(self, result, call_filePosa(self->fileno, keybuf, keyLen, lock));
     PyMem_Free(keybuf);
     if (result == -1) {
         PyErr_SetString(file400Error, "posa failed.");
@@ -1538,7 +2982,8 @@ File400_posf(File400Object *self, PyObject *args, PyObject *keywds)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_filePosf(self->fileno, lock);
+    f_prefetchStop(self, 0);
+    FILE_IO(self, result, call_filePosf(self->fileno, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "posa failed.");
         return NULL;
@@ -1563,7 +3008,8 @@ File400_posl(File400Object *self, PyObject *args, PyObject *keywds)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_filePosl(self->fileno, lock);
+    f_prefetchStop(self, 0);
+    FILE_IO(self, result, call_filePosl(self->fileno, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "posa failed.");
         return NULL;
@@ -1587,7 +3033,7 @@ File400_readrrn(File400Object *self, PyObject *args)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileReadrrn(self->fileno, self->recbuf, rrn, lock);
+    FILE_IO(self, result, call_fileReadrrn(self->fileno, self->recbuf, rrn, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readrrn failed.");
         return NULL;
@@ -1621,7 +3067,7 @@ File400_readeq(File400Object *self, PyObject *args, PyObject *keywds)
         PyMem_Free(keybuf);
         return NULL;
     }
-    result = call_fileReadeq(self->fileno, self->recbuf, keybuf, keyLen, lock);
+    FILE_IO(self, result, call_fileReadeq(self->fileno, self->recbuf, keybuf, keyLen, lock));
     PyMem_Free(keybuf);
     if (result == -1) {
         PyErr_SetString(file400Error, "readeq failed.");
@@ -1639,12 +3085,17 @@ Lock (for mode 'r+'). 1 - lock(default) 0 - no lock.";
 static PyObject *
 File400_readn(File400Object *self, PyObject *args)
 {
-    int result, lock = -1;
+    int result, rrn, lock = -1;
     if (!PyArg_ParseTuple(args, "|i:readn", &lock))
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileReadn(self->fileno, self->recbuf, lock);
+    if (self->prefetch != NULL) {
+        result = f_prefetchRead(self, 11, 0, self->recbuf, &rrn, 1);
+        if (result >= 0)
+            result = !result;
+    } else
+        FILE_IO(self, result, call_fileReadn(self->fileno, self->recbuf, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readn failed.");
         return NULL;
@@ -1664,7 +3115,7 @@ Lock (for mode 'r+'). 1 - lock(default) 0 - no lock.";
 static PyObject *
 File400_readne(File400Object *self, PyObject *args)
 {
-    int result, keyLen = 0, lock = -1;
+    int result, rrn, keyLen = 0, lock = -1;
     PyObject *key = Py_None;
 
     if (!PyArg_ParseTuple(args, "|Oi:readne", &key, &lock))
@@ -1680,7 +3131,12 @@ File400_readne(File400Object *self, PyObject *args)
         if (keyLen == -1)
             return NULL;
     }
-    result = call_fileReadne(self->fileno, self->recbuf, keyLen, lock);
+    if (self->prefetch != NULL) {
+        result = f_prefetchRead(self, 21, keyLen, self->recbuf, &rrn, 1);
+        if (result >= 0)
+            result = !result;
+    } else
+        FILE_IO(self, result, call_fileReadne(self->fileno, self->recbuf, keyLen, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readne failed.");
         return NULL;
@@ -1716,7 +3172,7 @@ File400_readpe(File400Object *self, PyObject *args)
         if (keyLen == -1)
             return NULL;
     }
-    result = call_fileReadpe(self->fileno, self->recbuf, keyLen, lock);
+    FILE_IO(self, result, call_fileReadpe(self->fileno, self->recbuf, keyLen, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readpe failed.");
         return NULL;
@@ -1738,7 +3194,7 @@ File400_readp(File400Object *self, PyObject *args)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileReadp(self->fileno, self->recbuf, lock);
+    FILE_IO(self, result, call_fileReadp(self->fileno, self->recbuf, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readp failed.");
         return NULL;
@@ -1762,7 +3218,7 @@ File400_readf(File400Object *self, PyObject *args, PyObject *keywds)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileReadf(self->fileno, self->recbuf, lock);
+    FILE_IO(self, result, call_fileReadf(self->fileno, self->recbuf, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readf failed.");
         return NULL;
@@ -1786,7 +3242,7 @@ File400_readl(File400Object *self, PyObject *args, PyObject *keywds)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileReadl(self->fileno, self->recbuf, lock);
+    FILE_IO(self, result, call_fileReadl(self->fileno, self->recbuf, lock));
     if (result == -1) {
         PyErr_SetString(file400Error, "readl failed.");
         return NULL;
@@ -1811,7 +3267,7 @@ File400_write(File400Object *self, PyObject *args)
         PyErr_SetString(file400Error, "File not opened for write.");
         return NULL;
     }
-    result = call_fileWrite(self->fileno, self->recbuf);
+    FILE_IO(self, result, call_fileWrite(self->fileno, self->recbuf));
     if (result == -1) {
         PyErr_SetString(file400Error, "write failed.");
         return NULL;
@@ -1820,27 +3276,184 @@ File400_write(File400Object *self, PyObject *args)
     return Py_None;
 }
 
-static char delete_doc[] =
-"f.delete() -> None.\n\
+static char writemany_doc[] =
+"f.writemany(rows) -> Number of records written.\n\
 \n\
-Deletes the currently locked record with the content of the buffer.";
-
-static PyObject *
-File400_delete(File400Object *self, PyObject *args)
+Appends many records with few calls to the service program.\n\
+rows is an iterable, a row can be a sequence of values in field order,\n\
+a dictionary of field values or bytes with the record.\n\
+Fields not given are cleared. In mode 'a' the output is blocked.\n\
+On error the exception tells the index of the row, the rows before it\n\
+are written. With blocked output the exception tells a range of rows\n\
+that may or may not be written, the rows before the range are written.";
+
+/* bytes of records per call */
+#define WRITEMANY_BLOCK 262144
+
+/* write n records from buf, first is the index of the first row */
+static int
+f_writeBlock(File400Object *self, char *buf, int n, Py_ssize_t first)
 {
-    int result;
-    if (!PyArg_ParseTuple(args, ":delete"))
-        return NULL;
-    if (!f_isOpen(self))
-        return NULL;
-    if (self->fi.omode != OPEN_UPDATE) {
-        PyErr_SetString(file400Error, "File not opened for update.");
-        return NULL;
+    int result, failed = 0;
+    FILE_IO(self, result, call_fileWriteBlock(self->fileno, buf, n, &failed));
+    if (result < 0) {
+        /* blocked, the rows of the call up to the error are not known to be written */
+        if (self->fi.omode == OPEN_WRITE)
+            PyErr_Format(file400Error, "writemany failed in rows %zd to %zd.", first, first + failed);
+        else
+            PyErr_Format(file400Error, "writemany failed at row %zd.", first + failed);
+        return -1;
     }
-    result = call_fileDelete(self->fileno);
-    if (result == -1) {
-        PyErr_SetString(file400Error, "delete failed.");
-        return NULL;
+    return 0;
+}
+
+/* put row into record, fields not given from the cleared record */
+static int
+f_encodeRow(File400Object *self, PyObject *row, char *rec, char *cleared)
+{
+    PyObject *key, *value, *seq;
+    Py_ssize_t dpos = 0;
+    Py_buffer view;
+    int i, pos, result = 0;
+
+    if (PyObject_CheckBuffer(row)) {
+        if (PyObject_GetBuffer(row, &view, PyBUF_SIMPLE) < 0)
+            return -1;
+        if (view.len != self->fi.recLen) {
+            PyBuffer_Release(&view);
+            PyErr_SetString(file400Error, "Record size not valid.");
+            return -1;
+        }
+        memcpy(rec, view.buf, view.len);
+        PyBuffer_Release(&view);
+        return 0;
+    }
+    memcpy(rec, cleared, self->fi.recLen);
+    if (PyDict_Check(row)) {
+        while (result == 0 && PyDict_Next(row, &dpos, &key, &value)) {
+            pos = f_getFieldPos(self, key);
+            if (pos < 0) {
+                PyErr_SetString(file400Error, "Field not valid.");
+                return -1;
+            }
+            result = f_setFieldValue(self, pos, value, rec);
+        }
+        return result;
+    }
+    if (PyUnicode_Check(row) || !PySequence_Check(row)) {
+        PyErr_SetString(file400Error, "Row must be a sequence, a dictionary or bytes.");
+        return -1;
+    }
+    seq = PySequence_Fast(row, "Row not valid.");
+    if (seq == NULL)
+        return -1;
+    if (PySequence_Fast_GET_SIZE(seq) > self->fi.fieldCount) {
+        Py_DECREF(seq);
+        PyErr_SetString(file400Error, "Too many values in row.");
+        return -1;
+    }
+    for (i = 0; result == 0 && i < PySequence_Fast_GET_SIZE(seq); i++)
+        result = f_setFieldValue(self, i, PySequence_Fast_GET_ITEM(seq, i), rec);
+    Py_DECREF(seq);
+    return result;
+}
+
+static PyObject *
+File400_writemany(File400Object *self, PyObject *args)
+{
+    PyObject *rows, *it, *row, *type, *value, *tb;
+    char *buf, *cleared;
+    int n = 0, max, recLen, result = 0;
+    Py_ssize_t count = 0;
+
+    if (!PyArg_ParseTuple(args, "O:writemany", &rows))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (self->fi.omode == OPEN_READ) {
+        PyErr_SetString(file400Error, "File not opened for write.");
+        return NULL;
+    }
+    it = PyObject_GetIter(rows);
+    if (it == NULL)
+        return NULL;
+    recLen = self->fi.recLen;
+    max = WRITEMANY_BLOCK / recLen;
+    if (max < 1)
+        max = 1;
+    /* records and the cleared record */
+    buf = PyMem_Malloc((size_t)(max + 1) * recLen);
+    if (buf == NULL) {
+        Py_DECREF(it);
+        return PyErr_NoMemory();
+    }
+    cleared = buf + (size_t)max * recLen;
+    f_clear(self, cleared);
+    while ((row = PyIter_Next(it)) != NULL) {
+        result = f_encodeRow(self, row, buf + (size_t)n * recLen, cleared);
+        Py_DECREF(row);
+        if (result < 0) {
+            PyErr_Fetch(&type, &value, &tb);
+            PyErr_NormalizeException(&type, &value, &tb);
+            PyErr_Format(file400Error, "writemany failed at row %zd. %S", count + n, value);
+            Py_XDECREF(type);
+            Py_XDECREF(value);
+            Py_XDECREF(tb);
+            break;
+        }
+        if (++n == max) {
+            result = f_writeBlock(self, buf, n, count);
+            if (result < 0) {
+                n = 0;
+                break;
+            }
+            count += n;
+            n = 0;
+        }
+    }
+    Py_DECREF(it);
+    if (PyErr_Occurred())
+        result = -1;
+    /* the rows before an error are written */
+    if (n > 0) {
+        PyErr_Fetch(&type, &value, &tb);
+        if (f_writeBlock(self, buf, n, count) == 0) {
+            count += n;
+            PyErr_Restore(type, value, tb);
+        } else {
+            Py_XDECREF(type);
+            Py_XDECREF(value);
+            Py_XDECREF(tb);
+            result = -1;
+        }
+    }
+    PyMem_Free(buf);
+    if (result < 0)
+        return NULL;
+    return PyLong_FromSsize_t(count);
+}
+
+static char delete_doc[] =
+"f.delete() -> None.\n\
+\n\
+Deletes the currently locked record with the content of the buffer.";
+
+static PyObject *
+File400_delete(File400Object *self, PyObject *args)
+{
+    int result;
+    if (!PyArg_ParseTuple(args, ":delete"))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (self->fi.omode != OPEN_UPDATE) {
+        PyErr_SetString(file400Error, "File not opened for update.");
+        return NULL;
+    }
+    FILE_IO(self, result, call_fileDelete(self->fileno));
+    if (result == -1) {
+        PyErr_SetString(file400Error, "delete failed.");
+        return NULL;
     }
     Py_INCREF(Py_None);
     return Py_None;
@@ -1863,7 +3476,7 @@ File400_update(File400Object *self, PyObject *args)
         PyErr_SetString(file400Error, "File not opened for update.");
         return NULL;
     }
-    result = call_fileUpdate(self->fileno, self->recbuf);
+    FILE_IO(self, result, call_fileUpdate(self->fileno, self->recbuf));
     if (result == -1) {
         PyErr_SetString(file400Error, "update failed.");
         return NULL;
@@ -1885,7 +3498,7 @@ File400_rlsLock(File400Object *self, PyObject *args)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileRlsLock(self->fileno);
+    FILE_IO(self, result, call_fileRlsLock(self->fileno));
     if (result == -1) {
         PyErr_SetString(file400Error, "rlsLock failed.");
         return NULL;
@@ -2063,7 +3676,7 @@ File400_getRrn(File400Object *self, PyObject *args)
         return NULL;
     if (!f_isOpen(self))
         return NULL;
-    result = call_fileGetRrn(self->fileno);
+    FILE_IO(self, result, call_fileGetRrn(self->fileno));
     return PyLong_FromLong(result);
 }
 
@@ -2078,7 +3691,7 @@ File400_isOpen(File400Object *self, PyObject *args)
 {
     if (!PyArg_ParseTuple(args, ":isOpen"))
         return NULL;
-    return PyLong_FromLong((self->fieldArr != NULL));
+    return PyLong_FromLong((self->recbuf != NULL));
 }
 
 static char mode_doc[] =
@@ -2364,6 +3977,32 @@ File400_getBuffer(File400Object *self, PyObject *args)
     return PyBytes_FromStringAndSize(self->recbuf, self->fi.recLen);
 }
 
+/* buffer protocol over the record buffer, writable unless opened for read */
+static int
+File400_getbuffer(File400Object *self, Py_buffer *view, int flags)
+{
+    if (!f_isOpen(self)) {
+        view->obj = NULL;
+        return -1;
+    }
+    if (PyBuffer_FillInfo(view, (PyObject *)self, self->recbuf, self->fi.recLen,
+                          (self->fi.omode == OPEN_READ), flags) < 0)
+        return -1;
+    self->exports++;
+    return 0;
+}
+
+static void
+File400_releasebuffer(File400Object *self, Py_buffer *view)
+{
+    self->exports--;
+}
+
+static PyBufferProcs File400_as_buffer = {
+    .bf_getbuffer = (getbufferproc)File400_getbuffer,
+    .bf_releasebuffer = (releasebufferproc)File400_releasebuffer,
+};
+
 static char set_doc[] =
 "f.set(Field, Value) -> String.\n\
 \n\
@@ -2477,192 +4116,3389 @@ File400_subscript(File400Object *self, PyObject *v)
 static PyObject *
 File400_iternext(File400Object *self)
 {
-    PyObject *res;
-    res = File400_readne(self, Py_BuildValue("()"));
-    if (res == NULL || PyLong_AS_LONG(res) == 1)
+    int result;
+    if (!f_isOpen(self))
+        return NULL;
+    FILE_IO(self, result, call_fileReadne(self->fileno, self->recbuf, 0, -1));
+    if (result == -1) {
+        PyErr_SetString(file400Error, "readne failed.");
+        return NULL;
+    }
+    if (result == 1)
         return NULL;
     Py_INCREF(self);
     return (PyObject *)self;
 }
 
-static PyMappingMethods File400_as_mapping = {
-    (lenfunc)File400_length, /*mp_length*/
-    (binaryfunc)File400_subscript, /*mp_subscript*/
-    (objobjargproc)File400_ass_subscript, /*mp_ass_subscript*/
-};
-
-PyDoc_STRVAR(exit_doc,
-	     "__exit__(*excinfo) -> None.  release lock.");
+/* Row object, a snapshot of a record with fields converted on first access */
+typedef struct {
+	PyObject_HEAD
+	File400Object *file;    /* file with the decode plan */
+	PyObject **values;      /* converted values, NULL until accessed */
+	char *recbuf;           /* copy of the record */
+	int rrn;                /* relative record number */
+	int fieldCount;         /* format of the record, the file may be opened again */
+	int recLen;
+} RowObject;
 
 static PyObject *
-File400_exit(File400Object *self, PyObject *args)
+f_newRow(File400Object *file, char *rec, int rrn)
 {
-    if (!f_isOpen(self))
+    RowObject *row;
+    int count = file->fi.fieldCount;
+    row = PyObject_New(RowObject, &Row_Type);
+    if (row == NULL)
         return NULL;
-    call_fileRlsLock(self->fileno);
-    Py_INCREF(Py_None);
-    return Py_None;
+    /* values and record in one allocation */
+    row->values = PyMem_Malloc(count * sizeof(PyObject *) + file->fi.recLen);
+    if (row->values == NULL) {
+        row->recbuf = NULL;
+        row->file = NULL;
+        Py_DECREF(row);
+        return PyErr_NoMemory();
+    }
+    memset(row->values, 0, count * sizeof(PyObject *));
+    row->recbuf = (char *)(row->values + count);
+    memcpy(row->recbuf, rec, file->fi.recLen);
+    row->rrn = rrn;
+    row->fieldCount = count;
+    row->recLen = file->fi.recLen;
+    Py_INCREF(file);
+    row->file = file;
+    return (PyObject *)row;
 }
-PyDoc_STRVAR(enter_doc,
-	     "__enter__() -> self.");
 
+/* get value of field, converted once */
 static PyObject *
-File400_self(File400Object *self)
+f_rowValue(RowObject *self, int pos)
 {
-	Py_INCREF(self);
-	return (PyObject *)self;
+    PyObject *va;
+    if (pos >= self->fieldCount || self->values[pos] == NULL) {
+        /* closed, or opened again with another format */
+        if (self->file->plan == NULL || self->file->fi.fieldCount != self->fieldCount ||
+            self->file->fi.recLen != self->recLen) {
+            PyErr_SetString(file400Error, "File is closed.");
+            return NULL;
+        }
+        va = f_getFieldValue(self->file, pos, self->recbuf);
+        if (va == NULL)
+            return NULL;
+        self->values[pos] = va;
+    }
+    Py_INCREF(self->values[pos]);
+    return self->values[pos];
 }
 
-static PyMethodDef File400Object_methods[] = {
-    {"open",    (PyCFunction)File400_open,  METH_VARARGS|METH_KEYWORDS, open_doc},
-    {"close",   (PyCFunction)File400_close, METH_VARARGS,close_doc},
-    {"readn",   (PyCFunction)File400_readn, METH_VARARGS, readn_doc},
-    {"readp",   (PyCFunction)File400_readp, METH_VARARGS, readp_doc},
-    {"readrrn",  (PyCFunction)File400_readrrn,METH_VARARGS, readrrn_doc},
-    {"readeq",  (PyCFunction)File400_readeq,METH_VARARGS|METH_KEYWORDS, readeq_doc},
-    {"readne",  (PyCFunction)File400_readne,METH_VARARGS, readne_doc},
-    {"readpe",  (PyCFunction)File400_readpe,METH_VARARGS, readpe_doc},
-    {"readf",   (PyCFunction)File400_readf, METH_VARARGS|METH_KEYWORDS, readf_doc},
-    {"readl",   (PyCFunction)File400_readl, METH_VARARGS|METH_KEYWORDS, readl_doc},
-    {"posa",   (PyCFunction)File400_posa,   METH_VARARGS|METH_KEYWORDS, posa_doc},
-    {"posb",   (PyCFunction)File400_posb,   METH_VARARGS|METH_KEYWORDS, posb_doc},
-    {"posf",    (PyCFunction)File400_posf,  METH_VARARGS|METH_KEYWORDS, posf_doc},
-    {"posl",    (PyCFunction)File400_posl,  METH_VARARGS|METH_KEYWORDS, posl_doc},
-    {"write",   (PyCFunction)File400_write, METH_VARARGS, write_doc},
-    {"delete",  (PyCFunction)File400_delete,METH_VARARGS, delete_doc},
-    {"update",  (PyCFunction)File400_update,METH_VARARGS, update_doc},
-    {"rlsLock", (PyCFunction)File400_rlsLock,METH_VARARGS, rlsLock_doc},
-    {"clear",   (PyCFunction)File400_clear, METH_VARARGS, clear_doc},
-    {"get",     (PyCFunction)File400_get, METH_VARARGS|METH_KEYWORDS, get_doc},
-    {"getBuffer",(PyCFunction)File400_getBuffer, METH_VARARGS, getBuffer_doc},
-    {"getRrn",  (PyCFunction)File400_getRrn, METH_VARARGS, getRrn_doc},
-    {"isOpen",  (PyCFunction)File400_isOpen, METH_VARARGS, isOpen_doc},
-    {"mode",    (PyCFunction)File400_mode,   METH_VARARGS, mode_doc},
-    {"fileName",(PyCFunction)File400_fileName, METH_VARARGS, fileName_doc},
-    {"libName", (PyCFunction)File400_libName, METH_VARARGS, libName_doc},
-    {"fieldCount",(PyCFunction)File400_fieldCount, METH_VARARGS, fieldCount_doc},
-    {"fieldList",(PyCFunction)File400_fieldList, METH_VARARGS, fieldList_doc},
-    {"fieldDesc",(PyCFunction)File400_fieldDesc, METH_VARARGS, fieldDesc_doc},
-    {"fieldSize",(PyCFunction)File400_fieldSize, METH_VARARGS, fieldSize_doc},
-    {"fieldType",(PyCFunction)File400_fieldType, METH_VARARGS, fieldType_doc},
-    {"recordSize",(PyCFunction)File400_recordSize, METH_VARARGS, recordSize_doc},
-    {"keyCount",(PyCFunction)File400_keyCount, METH_VARARGS, keyCount_doc},
-    {"keyList",(PyCFunction)File400_keyList, METH_VARARGS, keyList_doc},
-    {"set", (PyCFunction)File400_set, METH_VARARGS, set_doc},
-    {"setBuffer",(PyCFunction)File400_setBuffer, METH_VARARGS, setBuffer_doc},
-    {"__exit__", (PyCFunction)File400_exit,METH_VARARGS, exit_doc},
-	{"__enter__", (PyCFunction)File400_self,METH_NOARGS, enter_doc},
-    {NULL}       /* sentinel */
-};
-
-static PyObject *
-File400_getattro(File400Object *self, PyObject *nameobj)
+static void
+Row_dealloc(RowObject *self)
 {
-    if (PyUnicode_Check(nameobj)) {
-        if (PyUnicode_READ_CHAR(nameobj, 0) == '_' && PyUnicode_READ_CHAR(nameobj, 1) != '_')
-            return File400_subscript(self, nameobj);
+    int i;
+    if (self->values) {
+        for (i = 0; i < self->fieldCount; i++)
+            Py_XDECREF(self->values[i]);
+        PyMem_Free(self->values);
     }
-    return PyObject_GenericGetAttr((PyObject *)self, nameobj);
+    Py_XDECREF(self->file);
+    PyObject_Del(self);
 }
 
-static int
-File400_setattro(File400Object *self, PyObject *nameobj, PyObject *v)
+static Py_ssize_t
+Row_length(RowObject *self)
 {
-    if (PyUnicode_Check(nameobj)) {
-        if (PyUnicode_READ_CHAR(nameobj, 0) == '_')
-            return File400_ass_subscript(self, nameobj, v);
-    }
-    return -1;
+    return self->fieldCount;
 }
 
-
-static int
-file400_initFile(File400Object *f)
+static PyObject *
+Row_item(RowObject *self, Py_ssize_t i)
 {
-    int result, bufsize;
-    char name2[12];
-    PyObject *obj;
-    fieldInfoStruct *fi;
-    fieldInfoStruct *ky;
-    result = call_fileInit(f->fileno);
-    if (!result)
-        result = call_fileGetStruct(f->fileno, &f->fi);
-    if (result == -1) {
-        PyErr_SetString(file400Error, "File initialization failed.");
-        return -1;
+    if (i < 0 || i >= self->fieldCount) {
+        PyErr_SetString(PyExc_IndexError, "Row index out of range.");
+        return NULL;
     }
-    // allocate
-    bufsize = f->fi.fieldCount * sizeof(fieldInfoStruct);
-    f->fieldArr = fi = PyMem_Malloc(bufsize);
-    result = call_fileGetFields(f->fileno, f->fieldArr, bufsize);
-    if (result == -1) {
-        PyErr_SetString(file400Error, "File initialization failed, getting field information.");
-        return -1;
+    return f_rowValue(self, i);
+}
+
+static PyObject *
+Row_subscript(RowObject *self, PyObject *v)
+{
+    int pos;
+    if (self->file->fieldDict == NULL) {
+        PyErr_SetString(file400Error, "File is closed.");
+        return NULL;
     }
-    /* add to dictionary */
-    f->fieldDict = PyDict_New();
-    for (int i = 0; i < f->fi.fieldCount; i++) {
-        Py_INCREF(Py_None);
-        obj = PyLong_FromLong(i);
-        // Save versions of the field name
-        PyDict_SetItemString(f->fieldDict, fi->name, obj);
-        strcpy(name2, fi->name);
-        strtolower(name2);
-        PyDict_SetItemString(f->fieldDict, name2, obj);
-        sprintf(name2, "_%s", fi->name);
-        PyDict_SetItemString(f->fieldDict, name2, obj);
-        strtolower(name2);
-        PyDict_SetItemString(f->fieldDict, name2, obj);
-        Py_DECREF(obj);
-        fi++;
+    pos = f_getFieldPos(self->file, v);
+    if (pos < 0) {
+        PyErr_SetString(file400Error, "Parameter not valid.");
+        return NULL;
     }
-    /* get key info */
-    if (f->fi.keyCount > 0) {
-        bufsize = f->fi.keyCount * sizeof(fieldInfoStruct);
-        f->keyArr = ky = PyMem_Malloc(bufsize);
-        result = call_fileGetKeyFields(f->fileno, f->keyArr, bufsize);
-        if (result == -1) {
-            PyErr_SetString(file400Error, "File initialization failed, getting key information.");
-            return -1;
-        }
-        f->keyDict = PyDict_New();
-        for (int j = 0; j < f->fi.keyCount; j++) {
-            obj = PyDict_GetItemString(f->fieldDict, ky->name);
-            if (obj != NULL) {
-                strcpy(ky->desc, f->fieldArr[PyLong_AS_LONG(obj)].desc);
-                ky->ccsid = f->fieldArr[PyLong_AS_LONG(obj)].ccsid;
-            } else {
-                *ky->desc = '\0';
-                ky->ccsid = 0;
-            }
-            obj = PyLong_FromLong(j);
-            PyDict_SetItemString(f->keyDict, ky->name, obj);
-            sprintf(name2, "_%s", ky->name);
-            PyDict_SetItemString(f->keyDict, name2, obj);
-            Py_DECREF(obj);
-            ky++;
-        }
+    return f_rowValue(self, pos);
+}
+
+static PyObject *
+Row_getattro(RowObject *self, PyObject *nameobj)
+{
+    PyObject *posO;
+    if (PyUnicode_Check(nameobj) && self->file->fieldDict != NULL) {
+        posO = PyDict_GetItem(self->file->fieldDict, nameobj);
+        if (posO != NULL)
+            return f_rowValue(self, PyLong_AS_LONG(posO));
     }
-    // allocate storage for record
-    f->recbuf = PyMem_Malloc(f->fi.recLen + 1);
-    // clear the record
-    f_clear(f, f->recbuf);
-    /* return ok */
-    return 0;
+    return PyObject_GenericGetAttr((PyObject *)self, nameobj);
 }
 
-char File400_doc[] =
-"File400(Filename[mode, lib, mbr]) -> File400 Object\n\
+static char rowGet_doc[] =
+"r.get([fields]) -> List or Value.\n\
 \n\
-Creates a new File400 Object.\n\
-Filename must exist.\n\
-mode - Open mode\n\
-    None - (default) read.\n\
-    'r'  - open for read.\n\
-    'a'  - open for append.\n\
-    'r+' - open for read, update and append.\n\
-lib     - Library, special values are *LIBL(default) and *CURLIB.\n\
-member  - Member to be opened, special value are *FIRST(default).\n\
+Get values from the row.\n\
+r.get() - List of all values.\n\
+r.get('cusno') - Value of the field cusno. Same as r['cusno'] or r.cusno\n\
+r.get(('cusno','name')) - List of values.";
+
+static PyObject *
+Row_get(RowObject *self, PyObject *args)
+{
+    PyObject *o = Py_None, *fo, *obj, *va;
+    int i, pos, len;
+
+    if (!PyArg_ParseTuple(args, "|O:get", &o))
+        return NULL;
+    if (o == Py_None) {
+        len = self->fieldCount;
+        obj = PyList_New(len);
+        for (i = 0; i < len; i++) {
+            va = f_rowValue(self, i);
+            if (va == NULL) {
+                Py_DECREF(obj);
+                return NULL;
+            }
+            PyList_SET_ITEM(obj, i, va);
+        }
+        return obj;
+    } else if (PyLong_Check(o) || PyUnicode_Check(o)) {
+        return Row_subscript(self, o);
+    } else if (PySequence_Check(o)) {
+        if (self->file->fieldDict == NULL) {
+            PyErr_SetString(file400Error, "File is closed.");
+            return NULL;
+        }
+        len = PySequence_Length(o);
+        obj = PyList_New(len);
+        for (i = 0; i < len; i++) {
+            fo = PySequence_GetItem(o, i);
+            pos = f_getFieldPos(self->file, fo);
+            Py_XDECREF(fo);
+            if (pos < 0) {
+                PyErr_SetString(file400Error, "Field not valid.");
+                Py_DECREF(obj);
+                return NULL;
+            }
+            va = f_rowValue(self, pos);
+            if (va == NULL) {
+                Py_DECREF(obj);
+                return NULL;
+            }
+            PyList_SET_ITEM(obj, i, va);
+        }
+        return obj;
+    }
+    PyErr_SetString(file400Error, "Request failed.");
+    return NULL;
+}
+
+static char rowGetBuffer_doc[] =
+"r.getBuffer() -> Bytes.\n\
+\n\
+Get the raw record of the row.";
+
+static PyObject *
+Row_getBuffer(RowObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ":getBuffer"))
+        return NULL;
+    return PyBytes_FromStringAndSize(self->recbuf, self->recLen);
+}
+
+static char rowGetRrn_doc[] =
+"r.getRrn() -> Long.\n\
+\n\
+Get the record number of the row.";
+
+static PyObject *
+Row_getRrn(RowObject *self, PyObject *args)
+{
+    if (!PyArg_ParseTuple(args, ":getRrn"))
+        return NULL;
+    return PyLong_FromLong(self->rrn);
+}
+
+static PySequenceMethods Row_as_sequence = {
+    .sq_length = (lenfunc)Row_length,
+    .sq_item = (ssizeargfunc)Row_item,
+};
+
+static PyMappingMethods Row_as_mapping = {
+    .mp_length = (lenfunc)Row_length,
+    .mp_subscript = (binaryfunc)Row_subscript,
+};
+
+static PyMethodDef Row_methods[] = {
+    {"get",       (PyCFunction)Row_get, METH_VARARGS, rowGet_doc},
+    {"getBuffer", (PyCFunction)Row_getBuffer, METH_VARARGS, rowGetBuffer_doc},
+    {"getRrn",    (PyCFunction)Row_getRrn, METH_VARARGS, rowGetRrn_doc},
+    {NULL}       /* sentinel */
+};
+
+PyTypeObject Row_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "file400.Row",
+    .tp_doc = "Record read from a File400, fields are converted when accessed.",
+    .tp_basicsize = sizeof(RowObject),
+    .tp_dealloc = (destructor)Row_dealloc,
+    .tp_as_sequence = &Row_as_sequence,
+    .tp_as_mapping = &Row_as_mapping,
+    .tp_getattro = (getattrofunc)Row_getattro,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_methods = Row_methods,
+};
+
+/* Iterator over rows, reads next equal */
+typedef struct {
+	PyObject_HEAD
+	File400Object *file;
+	int keyLen;
+	int lock;
+} RowIterObject;
+
+static void
+RowIter_dealloc(RowIterObject *self)
+{
+    Py_XDECREF(self->file);
+    PyObject_Del(self);
+}
+
+static PyObject *
+RowIter_next(RowIterObject *self)
+{
+    File400Object *f = self->file;
+    int result;
+    if (f->plan == NULL) {
+        PyErr_SetString(file400Error, "File is closed.");
+        return NULL;
+    }
+    FILE_IO(f, result, call_fileReadne(f->fileno, f->recbuf, self->keyLen, self->lock));
+    if (result == -1) {
+        PyErr_SetString(file400Error, "readne failed.");
+        return NULL;
+    }
+    if (result == 1)
+        return NULL;
+    FILE_IO(f, result, call_fileGetRrn(f->fileno));
+    return f_newRow(f, f->recbuf, result);
+}
+
+PyTypeObject RowIter_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "file400.RowIterator",
+    .tp_basicsize = sizeof(RowIterObject),
+    .tp_dealloc = (destructor)RowIter_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)RowIter_next,
+};
+
+static char row_doc[] =
+"f.row() -> Row.\n\
+\n\
+Get a copy of the record buffer as a Row object.\n\
+The fields are converted when accessed, by index r[0], name r['cusno']\n\
+or attribute r.cusno.";
+
+static PyObject *
+File400_row(File400Object *self, PyObject *args)
+{
+    int rrn;
+    if (!PyArg_ParseTuple(args, ":row"))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    FILE_IO(self, rrn, call_fileGetRrn(self->fileno));
+    return f_newRow(self, self->recbuf, rrn);
+}
+
+static char rows_doc[] =
+"f.rows([key][lock]) -> Iterator.\n\
+\n\
+Iterate over the following records as Row objects, same as repeated\n\
+readne() followed by row().\n\
+The key should be a number that says number of keyfields\n\
+to use from the key buffer.\n\
+If it's left out, the key from last posa/posb/readeq is used.";
+
+static PyObject *
+File400_rows(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    int keyLen = 0, lock = -1;
+    PyObject *key = Py_None;
+    RowIterObject *it;
+    static char *kwlist[] = {"key","lock", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|Oi:rows", kwlist, &key, &lock))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (key != Py_None) {
+        if (!PyLong_Check(key)) {
+            PyErr_SetString(file400Error, "rows Key must be a number of key fields.");
+            return NULL;
+        }
+        keyLen = f_keylen(self, key, NULL);
+        if (keyLen == -1)
+            return NULL;
+    }
+    it = PyObject_New(RowIterObject, &RowIter_Type);
+    if (it == NULL)
+        return NULL;
+    Py_INCREF(self);
+    it->file = self;
+    it->keyLen = keyLen;
+    it->lock = lock;
+    return (PyObject *)it;
+}
+
+/* make room for size more bytes in a command or predicate buffer */
+static char *
+f_cmdReserve(char **buf, int *alloc, int used, int size)
+{
+    char *p;
+    if (used + size > *alloc) {
+        *alloc = (used + size) * 2;
+        p = PyMem_Realloc(*buf, *alloc);
+        if (p == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        *buf = p;
+    }
+    return *buf + used;
+}
+
+/* predicate operators in where conditions */
+static struct {
+    char *name;
+    short op;
+} predOps[] = {
+    {"=", PRED_EQ}, {"==", PRED_EQ}, {"!=", PRED_NE}, {"<>", PRED_NE},
+    {"<", PRED_LT}, {"<=", PRED_LE}, {">", PRED_GT}, {">=", PRED_GE},
+    {"in", PRED_IN}, {"between", PRED_BETWEEN},
+    {NULL}
+};
+
+/* encode a where value in the field format, returns PV_ as the stored value compares or -1 */
+static int
+f_predValue(fieldInfoStruct *field, PyObject *o, char *p)
+{
+    fieldInfoStruct wf;
+    PyObject *stored, *empty, *enc;
+    unsigned __int128 u, max;
+    long long ll;
+    int i, lt, gt, dl, neg, frac, rc;
+    short sh;
+    float fl;
+    double d;
+    char *wbuf;
+
+    switch (field->type) {
+    /* binary, whole numbers */
+    case 0:
+        rc = f_pyToScaledTrunc(o, 0, &u, &neg, &frac);
+        if (rc < 0)
+            return -1;
+        max = (unsigned __int128)1 << (field->len * 8 - 1);
+        if (rc > 0 || u > max - !neg || (neg && u == max && frac))
+            return neg ? PV_LOW : PV_HIGH;
+        ll = neg ? (long long)(0 - (unsigned long long)u) : (long long)u;
+        if (field->len == 2) {
+            sh = (short)ll;
+            memcpy(p, &sh, 2);
+        } else if (field->len == 4) {
+            dl = (int)ll;
+            memcpy(p, &dl, 4);
+        } else
+            memcpy(p, &ll, 8);
+        return (frac == 0) ? PV_EXACT : neg ? PV_ABOVE : PV_BELOW;
+    /* float, rounded to the nearest and compared exactly by python */
+    case 1:
+        if (!PyLong_Check(o) && !PyFloat_Check(o) &&
+            !(f_decimalType() != NULL && PyObject_IsInstance(o, decimalType) == 1)) {
+            PyErr_SetString(file400Error, "Data conversion error.");
+            return -1;
+        }
+        d = PyFloat_AsDouble(o);
+        if (d == -1.0 && PyErr_Occurred()) {
+            if (!PyErr_ExceptionMatches(PyExc_OverflowError))
+                return -1;
+            PyErr_Clear();
+            stored = PyLong_FromLong(0);
+            neg = (stored != NULL && PyObject_RichCompareBool(o, stored, Py_LT) == 1);
+            Py_XDECREF(stored);
+            d = neg ? -HUGE_VAL : HUGE_VAL;
+        }
+        if (isnan(d)) {
+            PyErr_SetString(file400Error, "Data conversion error.");
+            return -1;
+        }
+        if (field->len == 4) {
+            fl = (float)d;
+            memcpy(p, &fl, 4);
+            d = fl;
+        } else
+            memcpy(p, &d, 8);
+        if ((stored = PyFloat_FromDouble(d)) == NULL)
+            return -1;
+        lt = PyObject_RichCompareBool(stored, o, Py_LT);
+        gt = PyObject_RichCompareBool(stored, o, Py_GT);
+        Py_DECREF(stored);
+        if (lt < 0 || gt < 0)
+            return -1;
+        return lt ? PV_BELOW : gt ? PV_ABOVE : PV_EXACT;
+    /* zoned, packed */
+    case 2: case 3:
+        rc = f_pyToScaledTrunc(o, field->dec, &u, &neg, &frac);
+        if (rc < 0)
+            return -1;
+        if (rc == 0) {
+            if (field->type == 3)
+                rc = u128topacked((unsigned char *)p, field->digits, u, neg && u != 0);
+            else
+                rc = u128tozoned((unsigned char *)p, field->digits, u, neg && u != 0);
+        }
+        if (rc != 0)
+            return neg ? PV_LOW : PV_HIGH;
+        return (frac == 0) ? PV_EXACT : neg ? PV_ABOVE : PV_BELOW;
+    /* graphic, vargraphic */
+    case 5: case 0x8005:
+        if (!PyUnicode_Check(o)) {
+            PyErr_SetString(file400Error, "Data conversion error.");
+            return -1;
+        }
+        enc = PyUnicode_AsEncodedString(o, "utf-16-be", NULL);
+        if (enc == NULL)
+            return -1;
+        wbuf = PyBytes_AS_STRING(enc);
+        i = PyBytes_GET_SIZE(enc);
+        rc = PV_EXACT;
+        if (field->type == 0x8005) {
+            /* longer than the field, the prefix stored is the closest below */
+            if (i > field->len - 2) {
+                i = (field->len - 2) & ~1;
+                rc = PV_BELOW;
+            }
+            sh = i / 2;
+            memcpy(p, &sh, 2);
+            memcpy(p + 2, wbuf, i);
+        } else if (i <= field->len) {
+            memcpy(p, wbuf, i);
+            for (; i + 1 < field->len; i += 2) {
+                p[i] = 0x00;
+                p[i + 1] = 0x20;
+            }
+        } else {
+            memcpy(p, wbuf, field->len);
+            /* only blanks past the field length are the same value */
+            for (i = field->len; i + 1 < PyBytes_GET_SIZE(enc) && wbuf[i] == 0x00 && wbuf[i + 1] == 0x20; i += 2)
+                ;
+            if (i + 1 < PyBytes_GET_SIZE(enc))
+                rc = (((unsigned char)wbuf[i] << 8 | (unsigned char)wbuf[i + 1]) > 0x20) ? PV_BELOW : PV_ABOVE;
+        }
+        Py_DECREF(enc);
+        return rc;
+    /* char, date, time, timestamp, varchar */
+    default:
+        if (!PyUnicode_Check(o) && !PyBytes_Check(o)) {
+            PyErr_SetString(file400Error, "Data conversion error.");
+            return -1;
+        }
+        /* put in a field wide enough for the whole value, and an empty value for the padding */
+        wf = *field;
+        wf.offset = 0;
+        wf.len = field->len + 8 + 4 * (PyUnicode_Check(o) ? PyUnicode_GET_LENGTH(o) : PyBytes_GET_SIZE(o));
+        if (wf.len > 32767) {
+            PyErr_Format(file400Error, "Value too long for field %s.", field->name);
+            return -1;
+        }
+        wbuf = PyMem_Malloc(2 * wf.len);
+        empty = PyUnicode_Check(o) ? PyUnicode_New(0, 0) : PyBytes_FromStringAndSize(NULL, 0);
+        if (wbuf == NULL || empty == NULL) {
+            PyMem_Free(wbuf);
+            Py_XDECREF(empty);
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (f_cvtFromPy(wbuf, &wf, o) < 0 || f_cvtFromPy(wbuf + wf.len, &wf, empty) < 0) {
+            PyMem_Free(wbuf);
+            Py_DECREF(empty);
+            return -1;
+        }
+        Py_DECREF(empty);
+        memcpy(p, wbuf, field->len);
+        rc = PV_EXACT;
+        if (field->type == 0x8004) {
+            /* longer than the field, the prefix stored is the closest below */
+            memcpy(&sh, wbuf, 2);
+            if (sh > field->len - 2) {
+                sh = field->len - 2;
+                memcpy(p, &sh, 2);
+                rc = PV_BELOW;
+            }
+        } else {
+            /* only padding past the field length is the same value */
+            for (i = field->len; i < wf.len && wbuf[i] == wbuf[wf.len + i]; i++)
+                ;
+            if (i < wf.len)
+                rc = ((unsigned char)wbuf[i] > (unsigned char)wbuf[wf.len + i]) ? PV_BELOW : PV_ABOVE;
+        }
+        PyMem_Free(wbuf);
+        return rc;
+    }
+}
+
+/* fold a value the field can not hold into the operator, PRED_TRUE if always true */
+static int
+f_predFold(int op, int pv)
+{
+    switch (pv) {
+    case PV_EXACT:
+        return op;
+    case PV_LOW:
+        return (op == PRED_EQ || op == PRED_LT || op == PRED_LE) ? PRED_FALSE : PRED_TRUE;
+    case PV_HIGH:
+        return (op == PRED_EQ || op == PRED_GT || op == PRED_GE) ? PRED_FALSE : PRED_TRUE;
+    }
+    /* between two field values, compare with the closest one stored */
+    switch (op) {
+    case PRED_EQ:
+        return PRED_FALSE;
+    case PRED_NE:
+        return PRED_TRUE;
+    case PRED_LT: case PRED_LE:
+        return (pv == PV_BELOW) ? PRED_LE : PRED_LT;
+    default:
+        return (pv == PV_BELOW) ? PRED_GT : PRED_GE;
+    }
+}
+
+/* put a condition with count values in the predicate program, returns used or -1 */
+static int
+f_putCond(char **buf, int *alloc, int used, int op, int pos, int count, char *val, int len)
+{
+    PredCond *pc;
+
+    if (f_cmdReserve(buf, alloc, used, sizeof(PredCond) + count * len) == NULL)
+        return -1;
+    pc = (PredCond *)(*buf + used);
+    pc->op = op;
+    pc->count = count;
+    pc->field = pos;
+    pc->size = count * len;
+    memcpy(pc + 1, val, count * len);
+    return used + sizeof(PredCond) + count * len;
+}
+
+/* add one where condition to the predicate program, returns used or -1 */
+static int
+f_addCond(File400Object *self, PyObject *cond, char **buf, int *alloc, int used, int *ncond)
+{
+    PyObject *name, *seq = NULL, *v;
+    fieldInfoStruct *field;
+    Py_ssize_t size;
+    int i, n, pos, op, count, len, pv, fold[2];
+    char *val;
+
+    if (!PyTuple_Check(cond) || (size = PyTuple_GET_SIZE(cond)) < 3 ||
+        !PyUnicode_Check(PyTuple_GET_ITEM(cond, 1))) {
+        PyErr_SetString(file400Error, "Condition must be a tuple (field, operator, value).");
+        return -1;
+    }
+    pos = f_getFieldPos(self, PyTuple_GET_ITEM(cond, 0));
+    if (pos < 0) {
+        PyErr_SetString(file400Error, "Field not valid.");
+        return -1;
+    }
+    field = &self->fieldArr[pos];
+    switch (field->type) {
+    case 0: case 1: case 2: case 3: case 4: case 5: case 11: case 12: case 13:
+    case 0x8004: case 0x8005:
+        break;
+    default:
+        PyErr_Format(file400Error, "Field %s can not be used in where.", field->name);
+        return -1;
+    }
+    name = PyTuple_GET_ITEM(cond, 1);
+    for (i = 0; predOps[i].name != NULL; i++) {
+        if (PyUnicode_CompareWithASCIIString(name, predOps[i].name) == 0)
+            break;
+    }
+    if (predOps[i].name == NULL) {
+        PyErr_Format(file400Error, "Operator %U not valid.", name);
+        return -1;
+    }
+    op = predOps[i].op;
+    /* date and time formats as *MDY or *USA do not sort as the bytes */
+    if ((field->type == 11 || field->type == 12) && op != PRED_EQ && op != PRED_NE && op != PRED_IN) {
+        PyErr_Format(file400Error, "Field %s allows only '=', '!=' and 'in'.", field->name);
+        return -1;
+    }
+    count = (op == PRED_BETWEEN) ? 2 : 1;
+    if (size != 2 + count) {
+        PyErr_Format(file400Error, "Condition with %U not valid.", name);
+        return -1;
+    }
+    if (op == PRED_IN) {
+        seq = PySequence_Fast(PyTuple_GET_ITEM(cond, 2), "in values must be a sequence.");
+        if (seq == NULL)
+            return -1;
+        count = PySequence_Fast_GET_SIZE(seq);
+        if (count < 1 || count > 32767) {
+            Py_DECREF(seq);
+            PyErr_SetString(file400Error, "Number of in values not valid.");
+            return -1;
+        }
+    }
+    len = (field->len + 3) & ~3;
+    val = PyMem_Malloc(count * len);
+    if (val == NULL) {
+        Py_XDECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(val, 0, count * len);
+    /* values in the field format, one the field can not hold changes the operator */
+    for (i = n = 0; i < count; i++) {
+        v = (seq != NULL) ? PySequence_Fast_GET_ITEM(seq, i) : PyTuple_GET_ITEM(cond, 2 + i);
+        pv = f_predValue(field, v, val + n * len);
+        if (pv < 0) {
+            Py_XDECREF(seq);
+            PyMem_Free(val);
+            return -1;
+        }
+        if (op == PRED_IN) {
+            /* an in value the field can not hold never matches */
+            if (pv == PV_EXACT)
+                n++;
+        } else
+            fold[n++] = f_predFold((op != PRED_BETWEEN) ? op : (i == 0) ? PRED_GE : PRED_LE, pv);
+    }
+    Py_XDECREF(seq);
+    if (op == PRED_IN) {
+        /* none of the in values fits, never true */
+        used = f_putCond(buf, alloc, used, (n > 0) ? PRED_IN : PRED_FALSE, pos, n, val, len);
+        (*ncond)++;
+    } else if (op == PRED_BETWEEN && fold[0] == PRED_GE && fold[1] == PRED_LE) {
+        used = f_putCond(buf, alloc, used, PRED_BETWEEN, pos, 2, val, len);
+        (*ncond)++;
+    } else if (fold[0] == PRED_FALSE || (n == 2 && fold[1] == PRED_FALSE)) {
+        used = f_putCond(buf, alloc, used, PRED_FALSE, pos, 0, val, len);
+        (*ncond)++;
+    } else {
+        /* each bound on its own, one that is always true is left out */
+        for (i = 0; i < n && used >= 0; i++) {
+            if (fold[i] != PRED_TRUE) {
+                used = f_putCond(buf, alloc, used, fold[i], pos, 1, val + i * len, len);
+                (*ncond)++;
+            }
+        }
+    }
+    PyMem_Free(val);
+    return used;
+}
+
+/* compile where conditions and end key to a predicate program, NULL on error */
+static char *
+f_compileWhere(File400Object *self, PyObject *where, char *endbuf, int endCnt)
+{
+    PredProgram *prog;
+    PyObject *seq;
+    char *buf;
+    int i, count, used, alloc, ncond = 0, endLen = 0;
+
+    /* one condition or a sequence of conditions */
+    if (PyTuple_Check(where) && PyTuple_GET_SIZE(where) > 0 && !PyTuple_Check(PyTuple_GET_ITEM(where, 0)))
+        seq = PyTuple_Pack(1, where);
+    else
+        seq = PySequence_Fast(where, "Where must be a sequence of conditions.");
+    if (seq == NULL)
+        return NULL;
+    if (endCnt > 0)
+        endLen = (self->fi.keyLen + 3) & ~3;
+    alloc = sizeof(PredProgram) + endLen + 256;
+    buf = PyMem_Malloc(alloc);
+    if (buf == NULL) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    used = sizeof(PredProgram);
+    if (endCnt > 0) {
+        memcpy(buf + used, endbuf, self->fi.keyLen);
+        used += endLen;
+    }
+    count = PySequence_Fast_GET_SIZE(seq);
+    for (i = 0; i < count && used >= 0; i++)
+        used = f_addCond(self, PySequence_Fast_GET_ITEM(seq, i), &buf, &alloc, used, &ncond);
+    Py_DECREF(seq);
+    if (used < 0) {
+        PyMem_Free(buf);
+        return NULL;
+    }
+    prog = (PredProgram *)buf;
+    prog->size = used;
+    prog->count = ncond;
+    prog->endCnt = endCnt;
+    prog->endLen = endLen;
+    return buf;
+}
+
+static char readmany_doc[] =
+"f.readmany(n[,key][,lock][,where]) -> List of Row.\n\
+\n\
+Read up to n records in one call, returns a list of Row objects,\n\
+an empty list at end of file.\n\
+Without key the next records are read as readn().\n\
+With key the next equal records are read as readne(), the key should\n\
+be a number that says number of keyfields to use from the key buffer,\n\
+0 uses the key from last posa/posb/readeq.\n\
+The record buffer holds the last record read.\n\
+Lock (for mode 'r+'). 1 - lock(default) 0 - no lock.\n\
+where - Conditions the records must match, as in scan().";
+
+/* read operation and key length for a block read, readn or readne */
+static int
+f_blockOper(File400Object *self, int n, PyObject *key, int *oper, int *keyLen)
+{
+    *oper = 11;
+    *keyLen = 0;
+    if (n <= 0) {
+        PyErr_SetString(file400Error, "Number of records not valid.");
+        return -1;
+    }
+    if (key != Py_None) {
+        if (!PyLong_Check(key)) {
+            PyErr_SetString(file400Error, "Key must be a number of key fields.");
+            return -1;
+        }
+        *oper = 21;
+        if (PyLong_AsLong(key) != 0) {
+            *keyLen = f_keylen(self, key, NULL);
+            if (*keyLen == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/* internal routine to read a block of records, buf must be freed by caller */
+static int
+f_readBlock(File400Object *self, int n, PyObject *key, int lock, PyObject *where, char **buf, int **rrns)
+{
+    int result, keyLen, oper, recLen;
+    char *pred = NULL;
+
+    if (f_blockOper(self, n, key, &oper, &keyLen) < 0)
+        return -1;
+    recLen = self->fi.recLen;
+    *buf = PyMem_Malloc((size_t)n * recLen + n * sizeof(int));
+    if (*buf == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    *rrns = (int *)(*buf + (size_t)n * recLen);
+    if (where != Py_None) {
+        pred = f_compileWhere(self, where, NULL, 0);
+        if (pred == NULL) {
+            PyMem_Free(*buf);
+            *buf = NULL;
+            return -1;
+        }
+        FILE_IO(self, result, call_fileReadwhere(self->fileno, *buf, *rrns, n, oper, keyLen, lock, pred));
+        PyMem_Free(pred);
+    } else if (self->prefetch != NULL)
+        result = f_prefetchRead(self, oper, keyLen, *buf, *rrns, n);
+    else
+        FILE_IO(self, result, call_fileReadmany(self->fileno, *buf, *rrns, n, oper, keyLen, lock));
+    if (result == -1) {
+        PyMem_Free(*buf);
+        *buf = NULL;
+        PyErr_SetString(file400Error, "Read failed.");
+        return -1;
+    }
+    /* keep last record in the record buffer */
+    if (result > 0)
+        memcpy(self->recbuf, *buf + (size_t)(result - 1) * recLen, recLen);
+    return result;
+}
+
+static PyObject *
+File400_readmany(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    int i, n, result, lock = -1, recLen;
+    int *rrns;
+    char *buf;
+    PyObject *key = Py_None, *where = Py_None, *list, *row;
+    static char *kwlist[] = {"n","key","lock","where", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "i|OiO:readmany", kwlist, &n, &key, &lock, &where))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    result = f_readBlock(self, n, key, lock, where, &buf, &rrns);
+    if (result == -1)
+        return NULL;
+    recLen = self->fi.recLen;
+    list = PyList_New(result);
+    if (list == NULL) {
+        PyMem_Free(buf);
+        return NULL;
+    }
+    for (i = 0; i < result; i++) {
+        row = f_newRow(self, buf + (size_t)i * recLen, rrns[i]);
+        if (row == NULL) {
+            Py_DECREF(list);
+            PyMem_Free(buf);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, row);
+    }
+    PyMem_Free(buf);
+    return list;
+}
+
+static char prefetch_doc[] =
+"f.prefetch([depth][,n][,key]) -> None.\n\
+\n\
+Read ahead in a background thread while the records are processed.\n\
+The thread reads blocks of n records (default 100) into a ring of depth\n\
+blocks (default 4), starting with the next readn(), readne() or readmany()\n\
+that reads the same way. key as in readmany(), None reads as readn(),\n\
+a number of key fields as readne().\n\
+posb(), posa(), posf(), posl() and close() stop the read-ahead, any other\n\
+operation stops it and puts the file back on the last record returned.\n\
+depth 0 stops the read-ahead. Only for files opened with mode 'r'.";
+
+static PyObject *
+File400_prefetch(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    int depth = 4, n = 100, oper, keyLen;
+    PyObject *key = Py_None;
+    static char *kwlist[] = {"depth","n","key", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|iiO:prefetch", kwlist, &depth, &n, &key))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    f_prefetchStop(self, 1);
+    if (depth == 0) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    if (self->fi.omode != OPEN_READ) {
+        PyErr_SetString(file400Error, "Read-ahead needs a file opened for read.");
+        return NULL;
+    }
+    if (depth < 0) {
+        PyErr_SetString(file400Error, "Depth not valid.");
+        return NULL;
+    }
+    if (f_blockOper(self, n, key, &oper, &keyLen) < 0)
+        return NULL;
+    if (self->pflock == NULL) {
+        self->pflock = PyThread_allocate_lock();
+        if (self->pflock == NULL) {
+            PyErr_SetString(file400Error, "Can not allocate lock.");
+            return NULL;
+        }
+    }
+    self->prefetch = f_prefetchNew(depth, n, self->fi.recLen);
+    if (self->prefetch == NULL)
+        return NULL;
+    self->prefetch->oper = oper;
+    self->prefetch->keyLen = keyLen;
+    self->prefetch->fileno = self->fileno;
+    self->prefetch->lock = self->lock;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static char execute_doc[] =
+"f.execute(ops) -> List of results.\n\
+\n\
+Runs a sequence of operations with one call to the service program.\n\
+Each operation is a tuple with the method name and its arguments:\n\
+ ('posb', key[, lock]), ('posa', key[, lock]), ('posf'[, lock]), ('posl'[, lock]),\n\
+ ('readeq', key[, lock]), ('readrrn', rrn[, lock]), ('readf'[, lock]), ('readl'[, lock]),\n\
+ ('readn'[, lock]), ('readp'[, lock]), ('readne'[, key][, lock]), ('readpe'[, key][, lock]),\n\
+ ('write'[, values]), ('update'[, values]), ('delete',), ('rlsLock',)\n\
+values is a dictionary of fields to change in the buffer before write or update,\n\
+the buffer holds the last record read.\n\
+A read returns a Row, or None if not found, posb returns 1 if found otherwise 0,\n\
+the others return None.\n\
+Stops at the first operation that fails, the operations before it are done.\n\
+The error raised has the position of the failed operation in index and\n\
+the results of the operations before it in results.";
+
+/* batch operations, kind of argument, max number of arguments and default lock */
+#define CMDARG_NONE 0
+#define CMDARG_KEY 1
+#define CMDARG_KEYCOUNT 2
+#define CMDARG_RRN 3
+#define CMDARG_VALUES 4
+static struct {
+    char *name;
+    short oper;
+    short arg;
+    short args;
+    short lock;
+} cmdTable[] = {
+    {"posb", CMD_POSB, CMDARG_KEY, 2, -1},
+    {"posa", CMD_POSA, CMDARG_KEY, 2, -1},
+    {"posf", CMD_POSF, CMDARG_NONE, 1, -1},
+    {"posl", CMD_POSL, CMDARG_NONE, 1, -1},
+    {"readeq", CMD_READEQ, CMDARG_KEY, 2, 1},
+    {"readrrn", CMD_READRRN, CMDARG_RRN, 2, 1},
+    {"readf", 1, CMDARG_NONE, 1, 1},
+    {"readl", 2, CMDARG_NONE, 1, 1},
+    {"readn", 11, CMDARG_NONE, 1, -1},
+    {"readp", 12, CMDARG_NONE, 1, -1},
+    {"readne", 21, CMDARG_KEYCOUNT, 2, -1},
+    {"readpe", 22, CMDARG_KEYCOUNT, 2, -1},
+    {"write", CMD_WRITE, CMDARG_VALUES, 1, 0},
+    {"update", CMD_UPDATE, CMDARG_VALUES, 1, 0},
+    {"delete", CMD_DELETE, CMDARG_NONE, 0, 0},
+    {"rlsLock", CMD_RLSLOCK, CMDARG_NONE, 0, 0},
+    {NULL}
+};
+
+/* add field patches for the values in the dictionary, returns used or -1 */
+static int
+f_cmdPatches(File400Object *self, PyObject *values, char **buf, int *alloc, int used, int *count)
+{
+    PyObject *key, *value;
+    Py_ssize_t dpos = 0;
+    fieldInfoStruct *field;
+    CmdPatch *patch;
+    char *scratch;
+    int pos;
+
+    *count = 0;
+    if (values == NULL || values == Py_None)
+        return used;
+    if (!PyDict_Check(values)) {
+        PyErr_SetString(file400Error, "Values must be a dictionary.");
+        return -1;
+    }
+    scratch = PyMem_Malloc(self->fi.recLen);
+    if (scratch == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memcpy(scratch, self->recbuf, self->fi.recLen);
+    while (PyDict_Next(values, &dpos, &key, &value)) {
+        pos = f_getFieldPos(self, key);
+        if (pos < 0) {
+            PyErr_SetString(file400Error, "Field not valid.");
+            used = -1;
+            break;
+        }
+        field = &self->fieldArr[pos];
+        if (f_setFieldValue(self, pos, value, scratch) ||
+            f_cmdReserve(buf, alloc, used, sizeof(CmdPatch) + ((field->len + 3) & ~3)) == NULL) {
+            used = -1;
+            break;
+        }
+        patch = (CmdPatch *)(*buf + used);
+        patch->offset = field->offset;
+        patch->len = field->len;
+        memcpy(patch + 1, scratch + field->offset, field->len);
+        used += sizeof(CmdPatch) + ((field->len + 3) & ~3);
+        (*count)++;
+    }
+    PyMem_Free(scratch);
+    return used;
+}
+
+/* add one operation to the command buffer, returns used or -1 */
+static int
+f_cmdAdd(File400Object *self, PyObject *op, char **buf, int *alloc, int used, int *reads)
+{
+    PyObject *name, *arg = NULL;
+    CmdHead *cmd;
+    Py_ssize_t argc;
+    int i, start, lock, keyLen = 0, count = 0;
+
+    if (!PyTuple_Check(op) || PyTuple_GET_SIZE(op) < 1 || !PyUnicode_Check(PyTuple_GET_ITEM(op, 0))) {
+        PyErr_SetString(file400Error, "Operation must be a tuple starting with a name.");
+        return -1;
+    }
+    name = PyTuple_GET_ITEM(op, 0);
+    for (i = 0; cmdTable[i].name != NULL; i++) {
+        if (PyUnicode_CompareWithASCIIString(name, cmdTable[i].name) == 0)
+            break;
+    }
+    if (cmdTable[i].name == NULL) {
+        PyErr_Format(file400Error, "Operation %U not valid.", name);
+        return -1;
+    }
+    argc = PyTuple_GET_SIZE(op) - 1;
+    if (argc > cmdTable[i].args ||
+        (argc == 0 && (cmdTable[i].arg == CMDARG_KEY || cmdTable[i].arg == CMDARG_RRN))) {
+        PyErr_Format(file400Error, "Arguments for %U not valid.", name);
+        return -1;
+    }
+    /* argument first and lock last */
+    if (cmdTable[i].arg != CMDARG_NONE && argc > 0)
+        arg = PyTuple_GET_ITEM(op, 1);
+    lock = cmdTable[i].lock;
+    if (argc == cmdTable[i].args && argc > (cmdTable[i].arg != CMDARG_NONE)) {
+        lock = PyLong_AsLong(PyTuple_GET_ITEM(op, argc));
+        if (lock == -1 && PyErr_Occurred())
+            return -1;
+    }
+    if ((cmdTable[i].oper == CMD_WRITE && self->fi.omode == OPEN_READ) ||
+        ((cmdTable[i].oper == CMD_UPDATE || cmdTable[i].oper == CMD_DELETE) && self->fi.omode != OPEN_UPDATE)) {
+        PyErr_SetString(file400Error, "File not opened for update.");
+        return -1;
+    }
+    start = used;
+    if (f_cmdReserve(buf, alloc, used, sizeof(CmdHead) + self->fi.keyLen + 4) == NULL)
+        return -1;
+    used += sizeof(CmdHead);
+    switch (cmdTable[i].arg) {
+    case CMDARG_KEY:
+        keyLen = f_keylen(self, arg, *buf + used);
+        if (keyLen < 0)
+            return -1;
+        used += (keyLen + 3) & ~3;
+        break;
+    case CMDARG_KEYCOUNT:
+        if (arg != NULL && arg != Py_None) {
+            if (!PyLong_Check(arg)) {
+                PyErr_SetString(file400Error, "Key must be a number of key fields.");
+                return -1;
+            }
+            keyLen = f_keylen(self, arg, NULL);
+            if (keyLen < 0)
+                return -1;
+        }
+        break;
+    case CMDARG_RRN:
+        keyLen = PyLong_AsLong(arg);
+        if (keyLen == -1 && PyErr_Occurred())
+            return -1;
+        break;
+    case CMDARG_VALUES:
+        used = f_cmdPatches(self, arg, buf, alloc, used, &count);
+        if (used < 0)
+            return -1;
+        keyLen = count;
+        break;
+    }
+    cmd = (CmdHead *)(*buf + start);
+    cmd->oper = cmdTable[i].oper;
+    cmd->lock = lock;
+    cmd->arg = keyLen;
+    cmd->size = used - start - sizeof(CmdHead);
+    if (cmd->oper < CMD_POSB || cmd->oper == CMD_READEQ || cmd->oper == CMD_READRRN)
+        (*reads)++;
+    return used;
+}
+
+/* results of the first count batch operations */
+static PyObject *
+f_cmdResults(File400Object *self, char *buf, int *status, char *recs, int count)
+{
+    PyObject *list, *o;
+    char *p = buf;
+    int i, oper;
+
+    list = PyList_New(count);
+    if (list == NULL)
+        return NULL;
+    for (i = 0; i < count; i++) {
+        oper = ((CmdHead *)p)->oper;
+        p += sizeof(CmdHead) + ((CmdHead *)p)->size;
+        if (oper < CMD_POSB || oper == CMD_READEQ || oper == CMD_READRRN) {
+            if (status[2 * i] == 0) {
+                o = f_newRow(self, recs, status[2 * i + 1]);
+                recs += self->fi.recLen;
+                if (o == NULL) {
+                    Py_DECREF(list);
+                    return NULL;
+                }
+            } else {
+                Py_INCREF(Py_None);
+                o = Py_None;
+            }
+        } else if (oper == CMD_POSB) {
+            o = PyLong_FromLong(status[2 * i]);
+        } else {
+            Py_INCREF(Py_None);
+            o = Py_None;
+        }
+        PyList_SET_ITEM(list, i, o);
+    }
+    return list;
+}
+
+static PyObject *
+File400_execute(File400Object *self, PyObject *args)
+{
+    int i, n, result, used = 0, alloc = 1024, reads = 0;
+    int *status;
+    char *buf, *recs, *p;
+    PyObject *ops, *seq, *list, *o, *msg, *exc;
+
+    if (!PyArg_ParseTuple(args, "O:execute", &ops))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    seq = PySequence_Fast(ops, "Operations must be a sequence.");
+    if (seq == NULL)
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    buf = PyMem_Malloc(alloc);
+    if (buf == NULL) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < n && used >= 0; i++)
+        used = f_cmdAdd(self, PySequence_Fast_GET_ITEM(seq, i), &buf, &alloc, used, &reads);
+    Py_DECREF(seq);
+    if (used < 0) {
+        PyMem_Free(buf);
+        return NULL;
+    }
+    /* status and records found after the commands */
+    p = f_cmdReserve(&buf, &alloc, used, n * 2 * sizeof(int) + reads * self->fi.recLen + 1);
+    if (p == NULL) {
+        PyMem_Free(buf);
+        return NULL;
+    }
+    status = (int *)p;
+    recs = p + n * 2 * sizeof(int);
+    FILE_IO(self, result, call_fileExecute(self->fileno, buf, n, self->recbuf, status, recs));
+    if (result < 0) {
+        PyErr_SetString(file400Error, "execute failed.");
+        PyMem_Free(buf);
+        return NULL;
+    }
+    list = f_cmdResults(self, buf, status, recs, result);
+    PyMem_Free(buf);
+    if (list == NULL || result == n)
+        return list;
+    /* the results before the failed operation go with the error */
+    exc = NULL;
+    msg = PyUnicode_FromFormat("execute failed at operation %d.", result);
+    if (msg != NULL)
+        exc = PyObject_CallFunctionObjArgs(file400Error, msg, NULL);
+    if (exc != NULL) {
+        o = PyLong_FromLong(result);
+        if (o == NULL || PyObject_SetAttrString(exc, "index", o) < 0 ||
+            PyObject_SetAttrString(exc, "results", list) < 0)
+            Py_CLEAR(exc);
+        Py_XDECREF(o);
+    }
+    if (exc != NULL)
+        PyErr_SetObject(file400Error, exc);
+    Py_XDECREF(exc);
+    Py_XDECREF(msg);
+    Py_DECREF(list);
+    return NULL;
+}
+
+/* Selector object, fields to get resolved once */
+typedef struct {
+	PyObject_HEAD
+	File400Object *file;
+	int count;              /* number of fields */
+	int *posArr;            /* field positions */
+	int *packOffset;        /* offset of each field in the selected bytes */
+	int *ranges;            /* count, size, offset and length of byte ranges */
+	PyObject *keys;         /* names or labels for dictionary and object */
+	int output;
+	PyObject *cls;
+} SelectorObject;
+
+static void
+Selector_dealloc(SelectorObject *self)
+{
+    if (self->posArr) PyMem_Free(self->posArr);
+    if (self->packOffset) PyMem_Free(self->packOffset);
+    if (self->ranges) PyMem_Free(self->ranges);
+    Py_XDECREF(self->keys);
+    Py_XDECREF(self->cls);
+    Py_XDECREF(self->file);
+    PyObject_Del(self);
+}
+
+/* output of the selected fields, plan is indexed by posArr if given */
+static PyObject *
+f_select(SelectorObject *self, char *rec, fieldPlan *plan, int *posArr)
+{
+    PyObject *obj, *dict, *va;
+    fieldPlan *fp;
+    int i;
+
+    if (self->output == LIST) {
+        obj = PyList_New(self->count);
+        if (obj == NULL)
+            return NULL;
+        dict = NULL;
+    } else if (self->output == OBJ) {
+        obj = f_createObject(self->cls);
+        if (obj == NULL) {
+            PyErr_SetString(file400Error, "Could not create object.");
+            return NULL;
+        }
+        dict = PyObject_GetAttrString(obj, "__dict__");
+        if (dict == NULL) {
+            PyErr_SetString(file400Error, "Object has no __dict__.");
+            Py_DECREF(obj);
+            return NULL;
+        }
+        Py_DECREF(dict);
+    } else {
+        obj = dict = PyDict_New();
+        if (obj == NULL)
+            return NULL;
+    }
+    for (i = 0; i < self->count; i++) {
+        fp = &plan[(posArr != NULL) ? posArr[i] : i];
+        va = fp->cvt(rec, fp);
+        if (va == NULL) {
+            Py_DECREF(obj);
+            return NULL;
+        }
+        if (dict == NULL)
+            PyList_SET_ITEM(obj, i, va);
+        else {
+            PyDict_SetItem(dict, PyTuple_GET_ITEM(self->keys, i), va);
+            Py_DECREF(va);
+        }
+    }
+    return obj;
+}
+
+/* s([row]) - fields from the record buffer, a Row or a record */
+static PyObject *
+Selector_call(SelectorObject *self, PyObject *args, PyObject *keywds)
+{
+    File400Object *f = self->file;
+    PyObject *row = Py_None, *obj;
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "|O:selector", &row))
+        return NULL;
+    if (f->plan == NULL) {
+        PyErr_SetString(file400Error, "File is closed.");
+        return NULL;
+    }
+    if (row == Py_None)
+        return f_select(self, f->recbuf, f->plan, self->posArr);
+    if (PyObject_TypeCheck(row, &Row_Type)) {
+        if (((RowObject *)row)->file != f || ((RowObject *)row)->recLen != f->fi.recLen) {
+            PyErr_SetString(file400Error, "Row is from another file.");
+            return NULL;
+        }
+        return f_select(self, ((RowObject *)row)->recbuf, f->plan, self->posArr);
+    }
+    if (PyObject_GetBuffer(row, &view, PyBUF_SIMPLE) < 0)
+        return NULL;
+    if (view.len != f->fi.recLen) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(file400Error, "Record size not valid.");
+        return NULL;
+    }
+    obj = f_select(self, view.buf, f->plan, self->posArr);
+    PyBuffer_Release(&view);
+    return obj;
+}
+
+static char selector_readmany_doc[] =
+"s.readmany(n[,key][,lock][,where]) -> List.\n\
+\n\
+Read up to n records as f.readmany(), returns the selected fields of\n\
+each record. Only the bytes of the selected fields are copied, in\n\
+mode 'r+' the record buffer holds the last record read so the locked\n\
+record can be updated, else it is not changed.";
+
+static PyObject *
+Selector_readmany(SelectorObject *self, PyObject *args, PyObject *keywds)
+{
+    File400Object *f = self->file;
+    int i, n, result, lock = -1, oper, keyLen, size;
+    int *rrns;
+    char *buf, *pred = NULL;
+    fieldPlan *plan;
+    PyObject *key = Py_None, *where = Py_None, *list, *obj;
+    static char *kwlist[] = {"n","key","lock","where", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "i|OiO:readmany", kwlist, &n, &key, &lock, &where))
+        return NULL;
+    if (f->plan == NULL) {
+        PyErr_SetString(file400Error, "File is closed.");
+        return NULL;
+    }
+    if (f_blockOper(f, n, key, &oper, &keyLen) < 0)
+        return NULL;
+    if (where != Py_None) {
+        pred = f_compileWhere(f, where, NULL, 0);
+        if (pred == NULL)
+            return NULL;
+    }
+    size = self->ranges[1];
+    buf = PyMem_Malloc((size_t)n * size + n * sizeof(int));
+    /* converters moved to the selected bytes */
+    plan = PyMem_Malloc(self->count * sizeof(fieldPlan));
+    if (buf == NULL || plan == NULL) {
+        PyMem_Free(buf);
+        PyMem_Free(plan);
+        PyMem_Free(pred);
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < self->count; i++) {
+        plan[i] = f->plan[self->posArr[i]];
+        plan[i].offset = self->packOffset[i];
+    }
+    rrns = (int *)(buf + (size_t)n * size);
+    /* in update mode the buffer follows the record read, it can be locked */
+    FILE_IO(f, result, call_fileReadselect(f->fileno, buf, rrns, n, oper, keyLen, lock, pred, self->ranges,
+                                           (f->fi.omode == OPEN_UPDATE) ? f->recbuf : NULL));
+    PyMem_Free(pred);
+    if (result == -1) {
+        PyMem_Free(buf);
+        PyMem_Free(plan);
+        PyErr_SetString(file400Error, "Read failed.");
+        return NULL;
+    }
+    list = PyList_New(result);
+    for (i = 0; list != NULL && i < result; i++) {
+        obj = f_select(self, buf + (size_t)i * size, plan, NULL);
+        if (obj == NULL) {
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, i, obj);
+    }
+    PyMem_Free(buf);
+    PyMem_Free(plan);
+    return list;
+}
+
+static PyMethodDef Selector_methods[] = {
+    {"readmany", (PyCFunction)Selector_readmany, METH_VARARGS|METH_KEYWORDS, selector_readmany_doc},
+    {NULL, NULL}
+};
+
+PyTypeObject Selector_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "file400.Selector",
+    .tp_basicsize = sizeof(SelectorObject),
+    .tp_dealloc = (destructor)Selector_dealloc,
+    .tp_call = (ternaryfunc)Selector_call,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_methods = Selector_methods,
+};
+
+/* byte ranges of the selected fields, sorted and merged */
+static int
+f_selectRanges(SelectorObject *sel, fieldInfoStruct *fieldArr)
+{
+    int i, j, k, t, n = 0, size = 0;
+    int *order;
+
+    order = PyMem_Malloc(sel->count * sizeof(int));
+    sel->ranges = PyMem_Malloc((2 + 2 * sel->count) * sizeof(int));
+    sel->packOffset = PyMem_Malloc(sel->count * sizeof(int));
+    if (order == NULL || sel->ranges == NULL || sel->packOffset == NULL) {
+        PyMem_Free(order);
+        PyErr_NoMemory();
+        return -1;
+    }
+    /* fields in record order */
+    for (i = 0; i < sel->count; i++) {
+        t = i;
+        for (j = i; j > 0 && fieldArr[sel->posArr[order[j - 1]]].offset > fieldArr[sel->posArr[t]].offset; j--)
+            order[j] = order[j - 1];
+        order[j] = t;
+    }
+    for (i = 0; i < sel->count; i++) {
+        fieldInfoStruct *field = &fieldArr[sel->posArr[order[i]]];
+        k = 2 + 2 * (n - 1);
+        if (n > 0 && field->offset <= sel->ranges[k] + sel->ranges[k + 1]) {
+            /* overlaps or follows the previous range */
+            if (field->offset + field->len > sel->ranges[k] + sel->ranges[k + 1]) {
+                size += field->offset + field->len - sel->ranges[k] - sel->ranges[k + 1];
+                sel->ranges[k + 1] = field->offset + field->len - sel->ranges[k];
+            }
+        } else {
+            k = 2 + 2 * n++;
+            sel->ranges[k] = field->offset;
+            sel->ranges[k + 1] = field->len;
+            size += field->len;
+        }
+        /* start of the range in the selected bytes plus the offset in the range */
+        sel->packOffset[order[i]] = size - (sel->ranges[k] + sel->ranges[k + 1] - field->offset);
+    }
+    sel->ranges[0] = n;
+    sel->ranges[1] = size;
+    PyMem_Free(order);
+    return 0;
+}
+
+static char selector_doc[] =
+"f.selector(fields[,output][,cls][,labels]) -> Selector.\n\
+\n\
+Resolves the fields once, the selector gets them as f.get(fields, ...).\n\
+s() - Values from the record buffer.\n\
+s(row) - Values from a Row or a record as bytes.\n\
+s.readmany(n[,key][,lock][,where]) - Values of the next n records,\n\
+only the bytes of the fields are copied from the service program.\n\
+output, cls and labels as in get(), labels can be any sequence.";
+
+static PyObject *
+File400_selector(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *fields, *labels = Py_None, *cls = Py_None, *fo, *name;
+    SelectorObject *sel;
+    int i, pos, output = LIST;
+    static char *kwlist[] = {"fields","output","cls","labels", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "O|iOO:selector", kwlist,
+                                     &fields, &output, &cls, &labels))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (output != LIST && output != OBJ && output != DICT) {
+        PyErr_SetString(file400Error, "Output not valid.");
+        return NULL;
+    }
+    if (cls == Py_None)
+        cls = fileRowClass;
+    else if (output == OBJ && !PyClass_Check(cls) && !PyType_Check(cls)) {
+        PyErr_SetString(file400Error, "cls not a valid type.");
+        return NULL;
+    }
+    if (!PySequence_Check(fields) || PyUnicode_Check(fields) || PySequence_Length(fields) < 1) {
+        PyErr_SetString(file400Error, "Fields must be a sequence.");
+        return NULL;
+    }
+    if (labels == Py_None)
+        labels = NULL;
+    else if (PyUnicode_Check(labels) || !PySequence_Check(labels)) {
+        PyErr_SetString(file400Error, "Labels must be a sequence.");
+        return NULL;
+    } else {
+        labels = PySequence_Fast(labels, "Labels must be a sequence.");
+        if (labels == NULL)
+            return NULL;
+    }
+    sel = PyObject_New(SelectorObject, &Selector_Type);
+    if (sel == NULL) {
+        Py_XDECREF(labels);
+        return NULL;
+    }
+    Py_INCREF(self);
+    sel->file = self;
+    Py_INCREF(cls);
+    sel->cls = cls;
+    sel->output = output;
+    sel->packOffset = NULL;
+    sel->ranges = NULL;
+    sel->count = PySequence_Length(fields);
+    sel->posArr = PyMem_Malloc(sel->count * sizeof(int));
+    sel->keys = PyTuple_New(sel->count);
+    if (sel->posArr == NULL || sel->keys == NULL)
+        goto error;
+    for (i = 0; i < sel->count; i++) {
+        fo = PySequence_GetItem(fields, i);
+        if (fo == NULL)
+            goto error;
+        pos = f_getFieldPos(self, fo);
+        Py_DECREF(fo);
+        if (pos < 0) {
+            PyErr_SetString(file400Error, "Field not valid.");
+            goto error;
+        }
+        sel->posArr[i] = pos;
+        /* output name, label if given */
+        if (labels != NULL && PySequence_Fast_GET_SIZE(labels) > i) {
+            name = PySequence_Fast_GET_ITEM(labels, i);
+            if (!PyUnicode_Check(name)) {
+                PyErr_SetString(file400Error, "Label not valid.");
+                goto error;
+            }
+            Py_INCREF(name);
+        } else
+            name = PyUnicode_FromString(self->fieldArr[pos].name);
+        if (name == NULL)
+            goto error;
+        PyUnicode_InternInPlace(&name);
+        PyTuple_SET_ITEM(sel->keys, i, name);
+    }
+    if (f_selectRanges(sel, self->fieldArr) < 0)
+        goto error;
+    Py_XDECREF(labels);
+    return (PyObject *)sel;
+error:
+    Py_XDECREF(labels);
+    Py_DECREF(sel);
+    return NULL;
+}
+
+/* Column object, values of one field exposed with the buffer protocol */
+typedef struct {
+	PyObject_HEAD
+	PyObject *name;         /* field name */
+	char *data;             /* values */
+	Py_ssize_t size;        /* number of values */
+	Py_ssize_t itemsize;    /* size of value */
+	Py_ssize_t alloc;       /* allocated size of data */
+	char *format;           /* struct format, q, d or B */
+	int scale;              /* decimal positions of int64 values */
+	PyObject *offsets;      /* offsets into data for strings */
+} ColumnObject;
+
+static ColumnObject *
+f_newColumn(PyObject *name, char *format, Py_ssize_t itemsize, Py_ssize_t size)
+{
+    ColumnObject *col;
+    col = PyObject_New(ColumnObject, &Column_Type);
+    if (col == NULL)
+        return NULL;
+    col->data = PyMem_Malloc(size * itemsize + 1);
+    if (col->data == NULL) {
+        col->name = NULL;
+        col->offsets = NULL;
+        Py_DECREF(col);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    Py_XINCREF(name);
+    col->name = name;
+    col->format = format;
+    col->itemsize = itemsize;
+    col->size = size;
+    col->alloc = size * itemsize + 1;
+    col->scale = 0;
+    Py_INCREF(Py_None);
+    col->offsets = Py_None;
+    return col;
+}
+
+/* make room for len more bytes in a byte column */
+static int
+f_columnReserve(ColumnObject *col, Py_ssize_t len)
+{
+    char *data;
+    Py_ssize_t alloc;
+    if (col->size + len <= col->alloc)
+        return 0;
+    alloc = col->alloc * 2;
+    if (alloc < col->size + len)
+        alloc = col->size + len;
+    data = PyMem_Realloc(col->data, alloc);
+    if (data == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    col->data = data;
+    col->alloc = alloc;
+    return 0;
+}
+
+/* get integer value from binary, zoned or packed field */
+static long long
+f_planInt64(char *rec, fieldPlan *fp)
+{
+    short dsh;
+    int dl;
+    long long dll;
+    char *p = rec + fp->offset;
+    switch (fp->field->type) {
+    case 0:
+        if (fp->len == 2) {
+            memcpy(&dsh, p, 2);
+            return dsh;
+        } else if (fp->len == 4) {
+            memcpy(&dl, p, 4);
+            return dl;
+        }
+        memcpy(&dll, p, 8);
+        return dll;
+    case 2:
+        return zonedtoll((unsigned char *)p, fp->digits);
+    default:
+        return packedtoll((unsigned char *)p, fp->digits);
+    }
+}
+
+/* add string to a string column, single byte ebcdic straight to utf-8 */
+static int
+f_columnAddString(ColumnObject *col, char *rec, fieldPlan *fp)
+{
+    PyObject *o;
+    const char *s;
+    Py_ssize_t len;
+    unsigned char *in;
+    unsigned char *out;
+    short varlen;
+    int i, size, trim = 1;
+    Py_UCS2 c;
+    cvtFunc cvt = (fp->base != NULL) ? fp->base : fp->cvt;
+
+    if (fp->sbcs != NULL) {
+        in = (unsigned char *)rec + fp->offset;
+        size = fp->len;
+        if (cvt == cvt_varSbcs) {
+            memcpy(&varlen, in, sizeof(short));
+            in += sizeof(short);
+            size = varlen;
+        } else if (cvt == cvt_sbcsNoTrim)
+            trim = 0;
+        if (trim) {
+            while (size > 0 && in[size - 1] == 0x40)
+                size--;
+        }
+        if (f_columnReserve(col, size * 3) < 0)
+            return -1;
+        out = (unsigned char *)col->data + col->size;
+        for (i = 0; i < size; i++) {
+            c = fp->sbcs->map[in[i]];
+            if (c < 0x80)
+                *out++ = c;
+            else if (c < 0x800) {
+                *out++ = 0xc0 | (c >> 6);
+                *out++ = 0x80 | (c & 0x3f);
+            } else {
+                *out++ = 0xe0 | (c >> 12);
+                *out++ = 0x80 | ((c >> 6) & 0x3f);
+                *out++ = 0x80 | (c & 0x3f);
+            }
+        }
+        col->size = (char *)out - col->data;
+        return 0;
+    }
+    o = cvt(rec, fp);
+    if (o == NULL)
+        return -1;
+    if (PyBytes_Check(o)) {
+        s = PyBytes_AS_STRING(o);
+        len = PyBytes_GET_SIZE(o);
+    } else {
+        s = PyUnicode_AsUTF8AndSize(o, &len);
+        if (s == NULL) {
+            Py_DECREF(o);
+            return -1;
+        }
+    }
+    if (f_columnReserve(col, len) < 0) {
+        Py_DECREF(o);
+        return -1;
+    }
+    memcpy(col->data + col->size, s, len);
+    col->size += len;
+    Py_DECREF(o);
+    return 0;
+}
+
+/* build column for field from block of records */
+static ColumnObject *
+f_fillColumn(File400Object *self, int pos, char *buf, int rows, int asfloat)
+{
+    fieldPlan *fp = &self->plan[pos];
+    ColumnObject *col, *offs;
+    PyObject *name, *o;
+    long long *lv;
+    double *dv;
+    char *rec;
+    int i, type = fp->field->type, recLen = self->fi.recLen;
+
+    name = PyUnicode_FromString(fp->field->name);
+    if (name == NULL)
+        return NULL;
+    /* integers with scale */
+    if (type == 0 || ((type == 2 || type == 3) && fp->digits <= 18)) {
+        if (asfloat && fp->dec > 0) {
+            col = f_newColumn(name, "d", sizeof(double), rows);
+            if (col == NULL)
+                goto error;
+            dv = (double *)col->data;
+            for (i = 0, rec = buf; i < rows; i++, rec += recLen) {
+                if (fp->dec < 23)
+                    dv[i] = (double)f_planInt64(rec, fp) / dblPow10[fp->dec];
+                else
+                    dv[i] = (double)f_planInt64(rec, fp) / pow(10, fp->dec);
+            }
+        } else {
+            col = f_newColumn(name, "q", sizeof(long long), rows);
+            if (col == NULL)
+                goto error;
+            col->scale = fp->dec;
+            lv = (long long *)col->data;
+            for (i = 0, rec = buf; i < rows; i++, rec += recLen)
+                lv[i] = f_planInt64(rec, fp);
+        }
+    }
+    /* float and large decimals */
+    else if (type == 1 || type == 2 || type == 3) {
+        col = f_newColumn(name, "d", sizeof(double), rows);
+        if (col == NULL)
+            goto error;
+        dv = (double *)col->data;
+        for (i = 0, rec = buf; i < rows; i++, rec += recLen) {
+            o = fp->cvt(rec, fp);
+            if (o == NULL) {
+                Py_DECREF(col);
+                goto error;
+            }
+            dv[i] = PyFloat_AsDouble(o);
+            Py_DECREF(o);
+            if (dv[i] == -1.0 && PyErr_Occurred()) {
+                Py_DECREF(col);
+                goto error;
+            }
+        }
+    }
+    /* strings, utf-8 data and offsets */
+    else {
+        offs = f_newColumn(NULL, "q", sizeof(long long), rows + 1);
+        if (offs == NULL)
+            goto error;
+        col = f_newColumn(name, "B", 1, 0);
+        if (col == NULL) {
+            Py_DECREF(offs);
+            goto error;
+        }
+        Py_DECREF(col->offsets);
+        col->offsets = (PyObject *)offs;
+        if (f_columnReserve(col, (Py_ssize_t)rows * fp->len) < 0) {
+            Py_DECREF(col);
+            goto error;
+        }
+        lv = (long long *)offs->data;
+        lv[0] = 0;
+        for (i = 0, rec = buf; i < rows; i++, rec += recLen) {
+            if (f_columnAddString(col, rec, fp) < 0) {
+                Py_DECREF(col);
+                goto error;
+            }
+            lv[i + 1] = col->size;
+        }
+    }
+    Py_DECREF(name);
+    return col;
+error:
+    Py_DECREF(name);
+    return NULL;
+}
+
+static char fetch_columns_doc[] =
+"f.fetch_columns([fields][,n][,key][,lock][,asfloat][,where]) -> List of Column.\n\
+\n\
+Read up to n (default 1000) records, same as readmany(), and return one\n\
+Column per field. A Column supports the buffer protocol so it can be\n\
+wrapped with numpy.frombuffer or memoryview without a Python object\n\
+per value.\n\
+fields - Sequence of field names or positions, default all fields.\n\
+asfloat - Return decimal fields with decimal positions as float64.\n\
+Binary, zoned and packed fields are int64 with decimal positions in\n\
+column.scale, float fields and decimals above 18 digits are float64,\n\
+other fields are utf-8 data with int64 column.offsets (rows + 1).\n\
+where - Conditions the records must match, as in scan().";
+
+static PyObject *
+File400_fetch_columns(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    int i, n = 1000, rows, pos, len, lock = -1, asfloat = 0;
+    int *rrns;
+    char *buf;
+    PyObject *fields = Py_None, *key = Py_None, *where = Py_None, *list, *fo;
+    ColumnObject *col;
+    static char *kwlist[] = {"fields","n","key","lock","asfloat","where", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OiOipO:fetch_columns", kwlist,
+                                     &fields, &n, &key, &lock, &asfloat, &where))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (fields != Py_None && !PySequence_Check(fields)) {
+        PyErr_SetString(file400Error, "Fields must be a sequence.");
+        return NULL;
+    }
+    len = (fields == Py_None) ? self->fi.fieldCount : PySequence_Length(fields);
+    if (len < 0)
+        return NULL;
+    rows = f_readBlock(self, n, key, lock, where, &buf, &rrns);
+    if (rows == -1)
+        return NULL;
+    list = PyList_New(len);
+    if (list == NULL)
+        goto error;
+    for (i = 0; i < len; i++) {
+        if (fields == Py_None)
+            pos = i;
+        else {
+            fo = PySequence_GetItem(fields, i);
+            if (fo == NULL)
+                goto error;
+            pos = f_getFieldPos(self, fo);
+            Py_DECREF(fo);
+            if (pos < 0) {
+                PyErr_SetString(file400Error, "Field not valid.");
+                goto error;
+            }
+        }
+        col = f_fillColumn(self, pos, buf, rows, asfloat);
+        if (col == NULL)
+            goto error;
+        PyList_SET_ITEM(list, i, (PyObject *)col);
+    }
+    PyMem_Free(buf);
+    return list;
+error:
+    Py_XDECREF(list);
+    PyMem_Free(buf);
+    return NULL;
+}
+
+static void
+Column_dealloc(ColumnObject *self)
+{
+    if (self->data)
+        PyMem_Free(self->data);
+    Py_XDECREF(self->name);
+    Py_XDECREF(self->offsets);
+    PyObject_Del(self);
+}
+
+static Py_ssize_t
+Column_length(ColumnObject *self)
+{
+    /* number of strings for string columns */
+    if (self->offsets != Py_None)
+        return ((ColumnObject *)self->offsets)->size - 1;
+    return self->size;
+}
+
+static int
+Column_getbuffer(ColumnObject *self, Py_buffer *view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "Column is read only.");
+        view->obj = NULL;
+        return -1;
+    }
+    view->buf = self->data;
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->len = self->size * self->itemsize;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->size : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs Column_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Column_getbuffer,
+};
+
+static PySequenceMethods Column_as_sequence = {
+    .sq_length = (lenfunc)Column_length,
+};
+
+static PyMemberDef Column_members[] = {
+    {"name", T_OBJECT, offsetof(ColumnObject, name), READONLY, "Field name."},
+    {"format", T_STRING, offsetof(ColumnObject, format), READONLY, "Format of values, q (int64), d (float64) or B (utf-8)."},
+    {"scale", T_INT, offsetof(ColumnObject, scale), READONLY, "Decimal positions of int64 values."},
+    {"offsets", T_OBJECT, offsetof(ColumnObject, offsets), READONLY, "Offsets column for strings, else None."},
+    {NULL}       /* sentinel */
+};
+
+PyTypeObject Column_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "file400.Column",
+    .tp_doc = "Values of one field from fetch_columns, supports the buffer protocol.",
+    .tp_basicsize = sizeof(ColumnObject),
+    .tp_dealloc = (destructor)Column_dealloc,
+    .tp_as_sequence = &Column_as_sequence,
+    .tp_as_buffer = &Column_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_members = Column_members,
+};
+
+/* compare packed or zoned values */
+static int
+f_decCmp(unsigned char *p1, unsigned char *p2, fieldInfoStruct *field)
+{
+    int i, n, d1, d2, neg1, neg2, cmp = 0;
+    n = field->digits;
+    if (field->type == 3) {
+        neg1 = (p1[n / 2] & 0x0f) == 0x0d || (p1[n / 2] & 0x0f) == 0x0b;
+        neg2 = (p2[n / 2] & 0x0f) == 0x0d || (p2[n / 2] & 0x0f) == 0x0b;
+    } else {
+        neg1 = (p1[n - 1] & 0xf0) == 0xd0 || (p1[n - 1] & 0xf0) == 0xb0;
+        neg2 = (p2[n - 1] & 0xf0) == 0xd0 || (p2[n - 1] & 0xf0) == 0xb0;
+    }
+    /* compare the absolute values digit by digit */
+    for (i = 0; i < n && cmp == 0; i++) {
+        if (field->type == 3) {
+            /* even number of digits has a leading pad nibble */
+            int j = i + 1 - (n & 1);
+            d1 = (j & 1) ? p1[j / 2] & 0x0f : p1[j / 2] >> 4;
+            d2 = (j & 1) ? p2[j / 2] & 0x0f : p2[j / 2] >> 4;
+        } else {
+            d1 = p1[i] & 0x0f;
+            d2 = p2[i] & 0x0f;
+        }
+        cmp = d1 - d2;
+    }
+    if (cmp == 0) {
+        /* equal absolute values, zero is equal whatever the sign */
+        if (neg1 == neg2)
+            return 0;
+        for (i = 0; i < n; i++) {
+            if (field->type == 3) {
+                int j = i + 1 - (n & 1);
+                d1 = (j & 1) ? p1[j / 2] & 0x0f : p1[j / 2] >> 4;
+            } else
+                d1 = p1[i] & 0x0f;
+            if (d1 != 0)
+                break;
+        }
+        if (i == n)
+            return 0;
+        return neg1 ? -1 : 1;
+    }
+    if (neg1 != neg2)
+        return neg1 ? -1 : 1;
+    return neg1 ? -cmp : cmp;
+}
+
+/* compare key field value in record with raw key value */
+static int
+f_keyCmp(char *p1, char *p2, fieldInfoStruct *key)
+{
+    short s1, s2, l1, l2;
+    int i1, i2, cmp;
+    long long ll1, ll2;
+    float f1, f2;
+    double d1, d2;
+
+    switch (key->type) {
+    /* binary */
+    case 0:
+        if (key->len == 2) {
+            memcpy(&s1, p1, 2);
+            memcpy(&s2, p2, 2);
+            return (s1 > s2) - (s1 < s2);
+        } else if (key->len == 4) {
+            memcpy(&i1, p1, 4);
+            memcpy(&i2, p2, 4);
+            return (i1 > i2) - (i1 < i2);
+        }
+        memcpy(&ll1, p1, 8);
+        memcpy(&ll2, p2, 8);
+        return (ll1 > ll2) - (ll1 < ll2);
+    /* float */
+    case 1:
+        if (key->len == 4) {
+            memcpy(&f1, p1, 4);
+            memcpy(&f2, p2, 4);
+            return (f1 > f2) - (f1 < f2);
+        }
+        memcpy(&d1, p1, 8);
+        memcpy(&d2, p2, 8);
+        return (d1 > d2) - (d1 < d2);
+    /* zoned, packed */
+    case 2: case 3:
+        return f_decCmp((unsigned char *)p1, (unsigned char *)p2, key);
+    /* varchar, vargraphic */
+    case 0x8004: case 0x8005:
+        memcpy(&l1, p1, 2);
+        memcpy(&l2, p2, 2);
+        cmp = memcmp(p1 + 2, p2 + 2, (l1 < l2) ? l1 : l2);
+        if (cmp == 0)
+            cmp = l1 - l2;
+        return cmp;
+    /* char, graphic, date, time, timestamp */
+    default:
+        return memcmp(p1, p2, key->len);
+    }
+}
+
+/* build output for the fields of the record buffer */
+static PyObject *
+f_outputRecord(File400Object *self, int *posArr, int count, int output, PyObject *cls)
+{
+    PyObject *obj, *dict, *va;
+    int i, pos;
+
+    if (output == LIST) {
+        obj = PyList_New(count);
+        if (obj == NULL)
+            return NULL;
+        for (i = 0; i < count; i++) {
+            pos = (posArr != NULL) ? posArr[i] : i;
+            va = f_getFieldValue(self, pos, self->recbuf);
+            if (va == NULL) {
+                Py_DECREF(obj);
+                return NULL;
+            }
+            PyList_SET_ITEM(obj, i, va);
+        }
+        return obj;
+    }
+    if (output == OBJ) {
+        obj = f_createObject(cls);
+        if (obj == NULL) {
+            PyErr_SetString(file400Error, "Could not create object.");
+            return NULL;
+        }
+        dict = PyObject_GetAttrString(obj, "__dict__");
+        if (dict == NULL) {
+            PyErr_SetString(file400Error, "Object has no __dict__.");
+            Py_DECREF(obj);
+            return NULL;
+        }
+        Py_DECREF(dict);
+    } else {
+        obj = dict = PyDict_New();
+        if (obj == NULL)
+            return NULL;
+    }
+    for (i = 0; i < count; i++) {
+        pos = (posArr != NULL) ? posArr[i] : i;
+        va = f_getFieldValue(self, pos, self->recbuf);
+        if (va == NULL) {
+            Py_DECREF(obj);
+            return NULL;
+        }
+        PyDict_SetItemString(dict, self->fieldArr[pos].name, va);
+        Py_DECREF(va);
+    }
+    return obj;
+}
+
+/* Scan object, iterator over a key range */
+typedef struct {
+	PyObject_HEAD
+	File400Object *file;
+	int keyLen;             /* length of start key, readne if no end key */
+	char *endbuf;           /* end key, NULL if none */
+	int endCnt;             /* number of key fields in end key */
+	int *keyPos;            /* field position of each key field */
+	int *posArr;            /* fields to return, NULL for all */
+	int count;              /* number of fields to return */
+	int output;
+	PyObject *cls;
+	int lock;
+	int done;
+	char *pred;             /* predicate program, NULL if no conditions */
+} ScanObject;
+
+static void
+Scan_dealloc(ScanObject *self)
+{
+    if (self->endbuf) PyMem_Free(self->endbuf);
+    if (self->pred) PyMem_Free(self->pred);
+    if (self->keyPos) PyMem_Free(self->keyPos);
+    if (self->posArr) PyMem_Free(self->posArr);
+    Py_XDECREF(self->cls);
+    Py_XDECREF(self->file);
+    PyObject_Del(self);
+}
+
+/* check if the record is past the end key */
+static int
+f_pastEnd(ScanObject *self)
+{
+    File400Object *f = self->file;
+    fieldInfoStruct *key;
+    int i, cmp;
+
+    for (i = 0; i < self->endCnt; i++) {
+        key = &f->keyArr[i];
+        cmp = f_keyCmp(f->recbuf + f->fieldArr[self->keyPos[i]].offset,
+                       self->endbuf + key->offset, key);
+        /* descending key */
+        if (key->dft)
+            cmp = -cmp;
+        if (cmp != 0)
+            return cmp > 0;
+    }
+    return 0;
+}
+
+static PyObject *
+Scan_next(ScanObject *self)
+{
+    File400Object *f = self->file;
+    int result, rrn, oper;
+
+    if (self->done)
+        return NULL;
+    if (f->plan == NULL) {
+        PyErr_SetString(file400Error, "File is closed.");
+        return NULL;
+    }
+    if (self->pred != NULL) {
+        /* the conditions and the end key are checked by the service program */
+        oper = (self->endbuf == NULL && self->keyLen > 0) ? 21 : 11;
+        FILE_IO(f, result, call_fileReadwhere(f->fileno, f->recbuf, &rrn, 1, oper,
+                                              self->keyLen, self->lock, self->pred));
+        if (result == -1) {
+            PyErr_SetString(file400Error, "scan read failed.");
+            return NULL;
+        }
+        if (result == 0) {
+            self->done = 1;
+            return NULL;
+        }
+        return f_outputRecord(f, self->posArr, self->count, self->output, self->cls);
+    }
+    if (self->endbuf == NULL && self->keyLen > 0)
+        FILE_IO(f, result, call_fileReadne(f->fileno, f->recbuf, self->keyLen, self->lock));
+    else
+        FILE_IO(f, result, call_fileReadn(f->fileno, f->recbuf, self->lock));
+    if (result == -1) {
+        PyErr_SetString(file400Error, "scan read failed.");
+        return NULL;
+    }
+    if (result == 0 && self->endbuf != NULL && f_pastEnd(self)) {
+        if (self->lock != 0)
+            FILE_IO(f, result, call_fileRlsLock(f->fileno));
+        result = 1;
+    }
+    if (result == 1) {
+        self->done = 1;
+        return NULL;
+    }
+    return f_outputRecord(f, self->posArr, self->count, self->output, self->cls);
+}
+
+PyTypeObject Scan_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "file400.Scan",
+    .tp_basicsize = sizeof(ScanObject),
+    .tp_dealloc = (destructor)Scan_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)Scan_next,
+};
+
+static char scan_doc[] =
+"f.scan([start_key][,end_key][,fields][,lock][,output][,cls][,where]) -> Iterator.\n\
+\n\
+Iterate over a key range, the read loop runs in C.\n\
+start_key - Sequence of key values, positions with posb().\n\
+            None starts at the beginning of the file.\n\
+end_key   - Sequence of key values, the scan stops after the last record\n\
+            with key less than or equal to end_key.\n\
+            If None, the records with key equal to start_key are returned.\n\
+fields    - Sequence of fields to return, default all.\n\
+lock      - 0 no lock(default), 1 lock (for mode 'r+').\n\
+output    - 0 list(default), 1 object, 2 dictionary, as in get().\n\
+where     - Condition or sequence of conditions that all must be true,\n\
+            (field, op, value) with op '=', '!=', '<', '<=', '>', '>=',\n\
+            (field, 'in', values) or (field, 'between', low, high).\n\
+            Values are put in the field format and compared with the\n\
+            record by the service program, only matching records are returned.\n\
+            A value the field can not hold is not rounded, the condition\n\
+            gives the same result as with the exact value.\n\
+            Date and time fields allow only '=', '!=' and 'in'.\n\
+>>> for cusno, name in f.scan((10,), (20,), ('cusno', 'name')): ...\n\
+>>> f.scan(where=[('status', 'in', ('O', 'B')), ('qty', '>', 0)])";
+
+static PyObject *
+File400_scan(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    int i, pos, result, keyLen = 0, lock = 0, output = LIST;
+    char *keybuf;
+    PyObject *start = Py_None, *end = Py_None, *fields = Py_None, *cls = Py_None, *fo, *posO;
+    ScanObject *sc;
+    PyObject *where = Py_None;
+    static char *kwlist[] = {"start_key","end_key","fields","lock","output","cls","where", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OOOiiOO:scan", kwlist,
+                                     &start, &end, &fields, &lock, &output, &cls, &where))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (output != LIST && output != OBJ && output != DICT) {
+        PyErr_SetString(file400Error, "Output not valid.");
+        return NULL;
+    }
+    if (cls == Py_None)
+        cls = fileRowClass;
+    else if (output == OBJ && !PyClass_Check(cls) && !PyType_Check(cls)) {
+        PyErr_SetString(file400Error, "cls not a valid type.");
+        return NULL;
+    }
+    sc = PyObject_New(ScanObject, &Scan_Type);
+    if (sc == NULL)
+        return NULL;
+    Py_INCREF(self);
+    sc->file = self;
+    Py_INCREF(cls);
+    sc->cls = cls;
+    sc->endbuf = NULL;
+    sc->keyPos = NULL;
+    sc->posArr = NULL;
+    sc->count = self->fi.fieldCount;
+    sc->output = output;
+    sc->lock = lock;
+    sc->done = 0;
+    sc->keyLen = 0;
+    sc->endCnt = 0;
+    sc->pred = NULL;
+    /* fields to return */
+    if (fields != Py_None) {
+        if (!PySequence_Check(fields)) {
+            PyErr_SetString(file400Error, "Fields must be a sequence.");
+            goto error;
+        }
+        sc->count = PySequence_Length(fields);
+        sc->posArr = PyMem_Malloc(sc->count * sizeof(int) + 1);
+        if (sc->posArr == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        for (i = 0; i < sc->count; i++) {
+            fo = PySequence_GetItem(fields, i);
+            if (fo == NULL)
+                goto error;
+            pos = f_getFieldPos(self, fo);
+            Py_DECREF(fo);
+            if (pos < 0) {
+                PyErr_SetString(file400Error, "Field not valid.");
+                goto error;
+            }
+            sc->posArr[i] = pos;
+        }
+    }
+    /* end key and the record position of the key fields */
+    if (end != Py_None) {
+        if (!PySequence_Check(end)) {
+            PyErr_SetString(file400Error, "End key must be a sequence of key values.");
+            goto error;
+        }
+        sc->endbuf = PyMem_Malloc(self->fi.keyLen + 1);
+        if (sc->endbuf == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        if (f_keylen(self, end, sc->endbuf) < 0)
+            goto error;
+        sc->endCnt = PySequence_Length(end);
+        sc->keyPos = PyMem_Malloc(sc->endCnt * sizeof(int) + 1);
+        if (sc->keyPos == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        for (i = 0; i < sc->endCnt; i++) {
+            posO = PyDict_GetItemString(self->fieldDict, self->keyArr[i].name);
+            if (posO == NULL) {
+                PyErr_SetString(file400Error, "Key field not in record.");
+                goto error;
+            }
+            sc->keyPos[i] = PyLong_AS_LONG(posO);
+        }
+    }
+    /* conditions, with the end key checked in the same program */
+    if (where != Py_None) {
+        sc->pred = f_compileWhere(self, where, sc->endbuf, sc->endCnt);
+        if (sc->pred == NULL)
+            goto error;
+    }
+    /* position */
+    if (start != Py_None) {
+        if (!PySequence_Check(start)) {
+            PyErr_SetString(file400Error, "Start key must be a sequence of key values.");
+            goto error;
+        }
+        keybuf = PyMem_Malloc(self->fi.keyLen + 1);
+        if (keybuf == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        keyLen = f_keylen(self, start, keybuf);
+        if (keyLen < 0) {
+            PyMem_Free(keybuf);
+            goto error;
+        }
+        FILE_IO(self, result, call_filePosb(self->fileno, keybuf, keyLen, lock));
+        PyMem_Free(keybuf);
+        sc->keyLen = keyLen;
+    } else
+        FILE_IO(self, result, call_filePosf(self->fileno, lock));
+    if (result == -1) {
+        PyErr_SetString(file400Error, "scan positioning failed.");
+        goto error;
+    }
+    return (PyObject *)sc;
+error:
+    Py_DECREF(sc);
+    return NULL;
+}
+
+static char aggregate_doc[] =
+"f.aggregate([key_range][,group_by_keys][,aggs][,where]) -> Dictionary or List.\n\
+\n\
+Count, sum, min and max over a key range. The records are read and\n\
+aggregated by the service program, only the results are returned.\n\
+key_range     - (start_key, end_key) as in scan(), None for all records.\n\
+group_by_keys - Number of key fields to group by, default 0.\n\
+aggs          - Dictionary of field and 'sum', 'min', 'max' or a sequence\n\
+                of them. With one aggregate the result is named as the\n\
+                field, with more as FIELD_SUM, FIELD_MIN and FIELD_MAX.\n\
+where         - Conditions the records must match, as in scan().\n\
+A result is a dictionary with the group key fields, 'count' and the\n\
+aggregates. Sums are exact, int or Decimal for fields with decimals,\n\
+float for float fields. Without group_by_keys one result is returned,\n\
+with group_by_keys a list of results in key order. No records are locked.\n\
+Date and time fields allow no min and max.\n\
+>>> f.aggregate(((2024, 1), (2024, 12)), 2, {'AMT': 'sum', 'QTY': ('min', 'max')})";
+
+static const struct {
+    const char *name;
+    const char *label;
+    int op;
+} aggOps[] = {
+    {"sum", "SUM", AGG_SUM}, {"min", "MIN", AGG_MIN}, {"max", "MAX", AGG_MAX},
+    {NULL, NULL, 0}
+};
+
+/* define one aggregate and add its result name, returns the new group size */
+static int
+f_addAgg(File400Object *self, int pos, PyObject *opO, int single, AggDef *ad,
+         PyObject *names, int outLen)
+{
+    fieldInfoStruct *field = &self->fieldArr[pos];
+    PyObject *name;
+    int i = 0;
+
+    if (PyUnicode_Check(opO))
+        for (i = 0; aggOps[i].name != NULL; i++)
+            if (PyUnicode_CompareWithASCIIString(opO, aggOps[i].name) == 0)
+                break;
+    if (!PyUnicode_Check(opO) || aggOps[i].name == NULL) {
+        PyErr_SetString(file400Error, "Aggregate not valid, use 'sum', 'min' or 'max'.");
+        return -1;
+    }
+    ad->op = aggOps[i].op;
+    ad->reserved = 0;
+    ad->field = pos;
+    ad->offset = outLen;
+    if (ad->op == AGG_SUM) {
+        if (field->type > 3) {
+            PyErr_SetString(file400Error, "Sum of a field that is not numeric.");
+            return -1;
+        }
+        /* 128 bit integer, or a double for float fields */
+        ad->len = 16;
+    } else {
+        /* date and time formats as *MDY or *USA do not sort as the bytes */
+        if (field->type == 11 || field->type == 12) {
+            PyErr_Format(file400Error, "Field %s allows no min or max.", field->name);
+            return -1;
+        }
+        ad->len = field->len;
+    }
+    if (single)
+        name = PyUnicode_FromString(field->name);
+    else
+        name = PyUnicode_FromFormat("%s_%s", field->name, aggOps[i].label);
+    if (name == NULL || PyList_Append(names, name) < 0) {
+        Py_XDECREF(name);
+        return -1;
+    }
+    Py_DECREF(name);
+    return outLen + ((ad->len + 7) & ~7);
+}
+
+/* sum as int, or Decimal with dec decimal positions */
+static PyObject *
+f_sumToPy(char *p, int dec)
+{
+    PyObject *val, *str, *res;
+
+    /* big endian two's complement */
+    val = _PyLong_FromByteArray((unsigned char *)p, 16, 0, 1);
+    if (val == NULL || dec <= 0)
+        return val;
+    if (f_decimalType() == NULL) {
+        Py_DECREF(val);
+        return NULL;
+    }
+    /* from the string, not limited by the context precision */
+    str = PyUnicode_FromFormat("%SE-%d", val, dec);
+    Py_DECREF(val);
+    if (str == NULL)
+        return NULL;
+    res = PyObject_CallFunctionObjArgs(decimalType, str, NULL);
+    Py_DECREF(str);
+    return res;
+}
+
+/* result dictionary of one group, the values are converted in place */
+static PyObject *
+f_aggGroup(File400Object *self, char *g, AggSpec *as, int keyCnt, PyObject *names)
+{
+    AggDef *ad = (AggDef *)(as + 1);
+    fieldPlan fp;
+    PyObject *dict, *posO, *va;
+    long long count;
+    double d;
+    int i;
+
+    dict = PyDict_New();
+    if (dict == NULL)
+        return NULL;
+    /* group key fields at their offset in the key */
+    for (i = 0; i < keyCnt; i++) {
+        posO = PyDict_GetItemString(self->fieldDict, self->keyArr[i].name);
+        if (posO == NULL) {
+            PyErr_SetString(file400Error, "Key field not in record.");
+            goto error;
+        }
+        fp = self->plan[PyLong_AS_LONG(posO)];
+        fp.offset = self->keyArr[i].offset;
+        va = fp.cvt(g, &fp);
+        if (va == NULL || PyDict_SetItemString(dict, self->keyArr[i].name, va) < 0) {
+            Py_XDECREF(va);
+            goto error;
+        }
+        Py_DECREF(va);
+    }
+    memcpy(&count, g + as->countOffset, 8);
+    va = PyLong_FromLongLong(count);
+    if (va == NULL || PyDict_SetItemString(dict, "count", va) < 0) {
+        Py_XDECREF(va);
+        goto error;
+    }
+    Py_DECREF(va);
+    for (i = 0; i < as->count; i++) {
+        if (ad[i].op != AGG_SUM) {
+            fp = self->plan[ad[i].field];
+            fp.offset = ad[i].offset;
+            va = fp.cvt(g, &fp);
+        } else if (self->fieldArr[ad[i].field].type == 1) {
+            memcpy(&d, g + ad[i].offset, 8);
+            va = PyFloat_FromDouble(d);
+        } else
+            va = f_sumToPy(g + ad[i].offset, self->fieldArr[ad[i].field].dec);
+        if (va == NULL || PyDict_SetItem(dict, PyList_GET_ITEM(names, i), va) < 0) {
+            Py_XDECREF(va);
+            goto error;
+        }
+        Py_DECREF(va);
+    }
+    return dict;
+error:
+    Py_DECREF(dict);
+    return NULL;
+}
+
+static PyObject *
+File400_aggregate(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *range = Py_None, *aggs = Py_None, *where = Py_None, *start = Py_None, *end = Py_None;
+    PyObject *names = NULL, *list = NULL, *obj, *fo, *ops, *seq, *empty = NULL;
+    int i, j, k, n, rc, keyCnt = 0, keyLen = 0, endCnt = 0, groupLen = 0, outLen, curOffset, max, pos;
+    Py_ssize_t ppos = 0;
+    char *keybuf = NULL, *endbuf = NULL, *pred = NULL, *spec = NULL, *out = NULL;
+    AggDef *defs = NULL;
+    AggSpec *as;
+    static char *kwlist[] = {"key_range","group_by_keys","aggs","where", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OiOO:aggregate", kwlist,
+                                     &range, &keyCnt, &aggs, &where))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (keyCnt < 0 || keyCnt > self->fi.keyCount) {
+        PyErr_SetString(file400Error, "Number of key fields not valid.");
+        return NULL;
+    }
+    if (range != Py_None) {
+        if (!PyTuple_Check(range) || PyTuple_GET_SIZE(range) != 2) {
+            PyErr_SetString(file400Error, "Key range must be (start_key, end_key).");
+            return NULL;
+        }
+        start = PyTuple_GET_ITEM(range, 0);
+        end = PyTuple_GET_ITEM(range, 1);
+        /* without end key the records equal to the start key */
+        if (end == Py_None)
+            end = start;
+    }
+    if (aggs != Py_None && !PyDict_Check(aggs)) {
+        PyErr_SetString(file400Error, "Aggregates must be a dictionary.");
+        return NULL;
+    }
+    /* number of aggregates */
+    n = 0;
+    while (aggs != Py_None && PyDict_Next(aggs, &ppos, &fo, &ops)) {
+        if (PyUnicode_Check(ops))
+            n++;
+        else if (PySequence_Check(ops) && PySequence_Length(ops) > 0)
+            n += PySequence_Length(ops);
+        else {
+            PyErr_SetString(file400Error, "Aggregate not valid, use 'sum', 'min' or 'max'.");
+            return NULL;
+        }
+    }
+    names = PyList_New(0);
+    defs = PyMem_Malloc(n * sizeof(AggDef) + 1);
+    if (names == NULL || defs == NULL) {
+        if (defs == NULL)
+            PyErr_NoMemory();
+        goto error;
+    }
+    /* group: key, count and values, each on 8 bytes */
+    for (i = 0; i < keyCnt; i++)
+        groupLen += self->keyArr[i].len;
+    outLen = ((groupLen + 7) & ~7) + 8;
+    k = 0;
+    ppos = 0;
+    while (aggs != Py_None && PyDict_Next(aggs, &ppos, &fo, &ops)) {
+        pos = f_getFieldPos(self, fo);
+        if (pos < 0) {
+            PyErr_SetString(file400Error, "Field not valid.");
+            goto error;
+        }
+        if (PyUnicode_Check(ops)) {
+            outLen = f_addAgg(self, pos, ops, 1, &defs[k++], names, outLen);
+            if (outLen < 0)
+                goto error;
+            continue;
+        }
+        seq = PySequence_Fast(ops, "Aggregate not valid.");
+        if (seq == NULL)
+            goto error;
+        for (j = 0; j < PySequence_Fast_GET_SIZE(seq) && outLen >= 0; j++)
+            outLen = f_addAgg(self, pos, PySequence_Fast_GET_ITEM(seq, j),
+                              PySequence_Fast_GET_SIZE(seq) == 1, &defs[k++], names, outLen);
+        Py_DECREF(seq);
+        if (outLen < 0)
+            goto error;
+    }
+    curOffset = (sizeof(AggSpec) + n * sizeof(AggDef) + 7) & ~7;
+    max = AGG_BLOCK / outLen;
+    if (max < 1)
+        max = 1;
+    spec = PyMem_Calloc(1, curOffset + outLen);
+    out = PyMem_Malloc((size_t)max * outLen);
+    if (spec == NULL || out == NULL) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    as = (AggSpec *)spec;
+    as->size = curOffset + outLen;
+    as->count = n;
+    as->groupLen = groupLen;
+    as->countOffset = ((groupLen + 7) & ~7);
+    as->outLen = outLen;
+    as->curOffset = curOffset;
+    as->state = AGG_READ;
+    memcpy(as + 1, defs, n * sizeof(AggDef));
+    /* end key and conditions in one program */
+    if (end != Py_None) {
+        if (!PySequence_Check(end)) {
+            PyErr_SetString(file400Error, "End key must be a sequence of key values.");
+            goto error;
+        }
+        endbuf = PyMem_Malloc(self->fi.keyLen + 1);
+        if (endbuf == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        if (f_keylen(self, end, endbuf) < 0)
+            goto error;
+        endCnt = PySequence_Length(end);
+    }
+    if (endCnt > 0 || where != Py_None) {
+        if (where == Py_None)
+            where = empty = PyTuple_New(0);
+        pred = f_compileWhere(self, where, endbuf, endCnt);
+        if (pred == NULL)
+            goto error;
+    }
+    /* position */
+    if (start != Py_None) {
+        if (!PySequence_Check(start)) {
+            PyErr_SetString(file400Error, "Start key must be a sequence of key values.");
+            goto error;
+        }
+        keybuf = PyMem_Malloc(self->fi.keyLen + 1);
+        if (keybuf == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        keyLen = f_keylen(self, start, keybuf);
+        if (keyLen < 0)
+            goto error;
+        FILE_IO(self, rc, call_filePosb(self->fileno, keybuf, keyLen, 0));
+    } else
+        FILE_IO(self, rc, call_filePosf(self->fileno, 0));
+    if (rc == -1) {
+        PyErr_SetString(file400Error, "aggregate positioning failed.");
+        goto error;
+    }
+    /* groups come in blocks, the open group stays in the spec */
+    list = PyList_New(0);
+    while (list != NULL && as->state != AGG_DONE) {
+        FILE_IO(self, rc, call_fileAggregate(self->fileno, pred, spec, out, max));
+        if (rc == -1) {
+            PyErr_SetString(file400Error, "Aggregate failed.");
+            goto error;
+        }
+        for (i = 0; i < rc; i++) {
+            obj = f_aggGroup(self, out + (size_t)i * outLen, as, keyCnt, names);
+            if (obj == NULL || PyList_Append(list, obj) < 0) {
+                Py_XDECREF(obj);
+                goto error;
+            }
+            Py_DECREF(obj);
+        }
+    }
+    if (list != NULL && keyCnt == 0) {
+        /* one result, without records the count is 0 and the values None */
+        if (PyList_GET_SIZE(list) > 0) {
+            obj = PyList_GET_ITEM(list, 0);
+            Py_INCREF(obj);
+        } else {
+            obj = Py_BuildValue("{s:i}", "count", 0);
+            for (i = 0; obj != NULL && i < n; i++)
+                if (PyDict_SetItem(obj, PyList_GET_ITEM(names, i), Py_None) < 0)
+                    Py_CLEAR(obj);
+        }
+        Py_SETREF(list, obj);
+    }
+    goto done;
+error:
+    Py_CLEAR(list);
+done:
+    Py_XDECREF(names);
+    Py_XDECREF(empty);
+    PyMem_Free(defs);
+    PyMem_Free(spec);
+    PyMem_Free(out);
+    PyMem_Free(pred);
+    PyMem_Free(keybuf);
+    PyMem_Free(endbuf);
+    return list;
+}
+
+static char parallel_scan_doc[] =
+"f.parallel_scan([fields][,workers][,callback][,n][,ordered][,output][,cls][,where]) -> List or int.\n\
+\n\
+Read the file in arrival sequence with several threads. The rrn range\n\
+is split in one part for each worker (default 4), each worker reads its\n\
+part with its own open of the file in blocks of n records (default 1000).\n\
+In rrn order the workers instead read chunks of n rrns in turn.\n\
+fields   - Sequence of fields to return, default all. Only the bytes\n\
+           of the fields are copied from the service program.\n\
+callback - Called with each block as a list, or an object with a put()\n\
+           method as queue.Queue. Returns the number of records.\n\
+           Without callback all records are returned in one list.\n\
+ordered  - True gives the blocks in rrn order, False(default) as read.\n\
+output, cls as in get(), where as in scan().\n\
+Records added while the file is read are not returned, the position\n\
+of f is not changed.\n\
+>>> f.parallel_scan(('cusno', 'name'), 8, out.put)";
+
+static PyObject *
+File400_parallel_scan(File400Object *self, PyObject *args, PyObject *keywds)
+{
+    PyObject *fields = Py_None, *callback = Py_None, *cls = Py_None, *where = Py_None;
+    PyObject *selArgs, *put = NULL, *list = NULL, *batch, *obj, *res = NULL;
+    SelectorObject *sel = NULL;
+    Prefetch **pfs = NULL, *pf;
+    fieldPlan *plan = NULL;
+    char *pred = NULL, *scratch, *rec;
+    int i, j, k, workers = 4, n = 1000, ordered = 0, output = LIST, depth = 2;
+    int result, fileno = -1, lastRrn = 0, per = 0, active, count, next;
+    long long total = 0;
+    static char *kwlist[] = {"fields","workers","callback","n","ordered","output","cls","where", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "|OiOipiOO:parallel_scan", kwlist, &fields,
+                                     &workers, &callback, &n, &ordered, &output, &cls, &where))
+        return NULL;
+    if (!f_isOpen(self))
+        return NULL;
+    if (workers < 1 || workers > 64) {
+        PyErr_SetString(file400Error, "Number of workers not valid.");
+        return NULL;
+    }
+    if (n <= 0) {
+        PyErr_SetString(file400Error, "Number of records not valid.");
+        return NULL;
+    }
+    /* the fields as a selector, all fields by position if not given */
+    if (fields == Py_None) {
+        fields = PyTuple_New(self->fi.fieldCount);
+        for (i = 0; fields != NULL && i < self->fi.fieldCount; i++)
+            PyTuple_SET_ITEM(fields, i, PyLong_FromLong(i));
+    } else
+        Py_INCREF(fields);
+    selArgs = Py_BuildValue("(NiO)", fields, output, cls);
+    if (selArgs == NULL)
+        return NULL;
+    sel = (SelectorObject *)File400_selector(self, selArgs, NULL);
+    Py_DECREF(selArgs);
+    if (sel == NULL)
+        return NULL;
+    if (callback != Py_None) {
+        put = PyObject_GetAttrString(callback, "put");
+        if (put == NULL) {
+            PyErr_Clear();
+            if (!PyCallable_Check(callback)) {
+                PyErr_SetString(file400Error, "Callback must be callable or have a put method.");
+                goto done;
+            }
+            Py_INCREF(callback);
+            put = callback;
+        }
+    } else if ((list = PyList_New(0)) == NULL)
+        goto done;
+    if (where != Py_None && (pred = f_compileWhere(self, where, NULL, 0)) == NULL)
+        goto done;
+    /* converters moved to the selected bytes */
+    plan = PyMem_Malloc(sel->count * sizeof(fieldPlan));
+    scratch = PyMem_Malloc(self->fi.recLen);
+    if (plan == NULL || scratch == NULL) {
+        PyMem_Free(scratch);
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < sel->count; i++) {
+        plan[i] = self->plan[sel->posArr[i]];
+        plan[i].offset = sel->packOffset[i];
+    }
+    /* the last rrn splits the file, from a handle in arrival sequence */
+    FILE_IO(self, fileno, call_fileDup(self->fileno, OPEN_ARRIVAL));
+    result = -1;
+    /* the new handle is only used here, no lock */
+    Py_BEGIN_ALLOW_THREADS
+    if (fileno >= 0) {
+        result = call_fileReadl(fileno, scratch, 0);
+        if (result == 0)
+            lastRrn = call_fileGetRrn(fileno);
+    }
+    Py_END_ALLOW_THREADS
+    PyMem_Free(scratch);
+    if (result == -1) {
+        PyErr_SetString(file400Error, "Read failed.");
+        goto done;
+    }
+    if (lastRrn <= 0)
+        workers = 0;
+    else {
+        /* a part for each worker, or chunks of n dealt in turn for rrn order */
+        per = ordered ? n : (lastRrn + workers - 1) / workers;
+        if (workers > (lastRrn + per - 1) / per)
+            workers = (lastRrn + per - 1) / per;
+        pfs = PyMem_Calloc(workers, sizeof(Prefetch *));
+        if (pfs == NULL) {
+            PyErr_NoMemory();
+            goto done;
+        }
+    }
+    for (k = 0; k < workers; k++) {
+        pfs[k] = f_prefetchNew(depth, n, sel->ranges[1]);
+        if (pfs[k] == NULL)
+            goto done;
+        /* the first worker gets the handle already open */
+        pfs[k]->fileno = fileno;
+        fileno = -1;
+        if (k > 0)
+            FILE_IO(self, pfs[k]->fileno, call_fileDup(self->fileno, OPEN_ARRIVAL));
+        if (pfs[k]->fileno < 0) {
+            PyErr_SetString(file400Error, "Failed creating File400 object.");
+            goto done;
+        }
+        pfs[k]->from = k * per + 1;
+        pfs[k]->to = ((k + 1) * per < lastRrn && !ordered) ? (k + 1) * per : lastRrn;
+        pfs[k]->step = ordered ? workers * n : 0;
+        pfs[k]->pred = pred;
+        pfs[k]->ranges = sel->ranges;
+    }
+    for (k = 0; k < workers; k++) {
+        if (PyThread_start_new_thread(f_prefetchRun, pfs[k]) == -1) {
+            PyErr_SetString(file400Error, "Can not start thread.");
+            goto done;
+        }
+        pfs[k]->started = 1;
+    }
+    active = workers;
+    k = 0;
+    next = 1;
+    while (active > 0) {
+        if (ordered) {
+            /* the worker with the chunk that starts at next */
+            pf = pfs[((next - 1) / n) % workers];
+            next += n;
+            if (pf->held && pf->count[pf->tail] <= 0)
+                continue;
+            if (!pf->held) {
+                f_acquire(pf->full[pf->tail]);
+                pf->held = 1;
+            }
+            /* a chunk without records has no block, the block is kept */
+            if (pf->count[pf->tail] > 0 && pf->chunk[pf->tail] != next - n)
+                continue;
+        } else {
+            /* skip the workers at their end */
+            while (pfs[k]->held && pfs[k]->count[pfs[k]->tail] <= 0)
+                k = (k + 1) % workers;
+            /* the first block ready */
+            for (j = 0; j < workers; j++) {
+                pf = pfs[(k + j) % workers];
+                if (!pf->held && PyThread_acquire_lock(pf->full[pf->tail], NOWAIT_LOCK)) {
+                    pf->held = 1;
+                    k = (k + j) % workers;
+                    break;
+                }
+            }
+            pf = pfs[k];
+            if (!pf->held) {
+                f_acquire(pf->full[pf->tail]);
+                pf->held = 1;
+            }
+        }
+        count = pf->count[pf->tail];
+        if (count <= 0) {
+            active--;
+            if (count < 0) {
+                PyErr_SetString(file400Error, "Read failed.");
+                goto done;
+            }
+            continue;
+        }
+        rec = pf->buf + (size_t)pf->tail * pf->n * pf->recLen;
+        batch = PyList_New(count);
+        for (i = 0; batch != NULL && i < count; i++) {
+            obj = f_select(sel, rec + (size_t)i * pf->recLen, plan, NULL);
+            if (obj == NULL)
+                Py_CLEAR(batch);
+            else
+                PyList_SET_ITEM(batch, i, obj);
+        }
+        /* the block is converted, the worker can fill it again */
+        PyThread_release_lock(pf->empty[pf->tail]);
+        pf->tail = (pf->tail + 1) % pf->depth;
+        pf->held = 0;
+        if (batch == NULL)
+            goto done;
+        total += count;
+        if (put == NULL)
+            result = PyList_SetSlice(list, PyList_GET_SIZE(list), PyList_GET_SIZE(list), batch);
+        else {
+            obj = PyObject_CallFunctionObjArgs(put, batch, NULL);
+            result = (obj == NULL) ? -1 : 0;
+            Py_XDECREF(obj);
+        }
+        Py_DECREF(batch);
+        if (result < 0)
+            goto done;
+        if (!ordered)
+            k = (k + 1) % workers;
+    }
+    if (put == NULL) {
+        Py_INCREF(list);
+        res = list;
+    } else
+        res = PyLong_FromLongLong(total);
+done:
+    /* stop the workers, also on error */
+    for (k = 0; pfs != NULL && k < workers; k++) {
+        if (pfs[k] == NULL)
+            continue;
+        Py_BEGIN_ALLOW_THREADS
+        if (pfs[k]->started)
+            f_prefetchDrain(pfs[k]);
+        if (pfs[k]->fileno >= 0)
+            call_fileFree(pfs[k]->fileno);
+        Py_END_ALLOW_THREADS
+        f_prefetchFree(pfs[k]);
+    }
+    if (fileno >= 0)
+        call_fileFree(fileno);
+    PyMem_Free(pfs);
+    PyMem_Free(plan);
+    PyMem_Free(pred);
+    Py_XDECREF(put);
+    Py_XDECREF(list);
+    Py_XDECREF(sel);
+    return res;
+}
+
+static PyMappingMethods File400_as_mapping = {
+    (lenfunc)File400_length, /*mp_length*/
+    (binaryfunc)File400_subscript, /*mp_subscript*/
+    (objobjargproc)File400_ass_subscript, /*mp_ass_subscript*/
+};
+
+PyDoc_STRVAR(exit_doc,
+	     "__exit__(*excinfo) -> None.  release lock.");
+
+static PyObject *
+File400_exit(File400Object *self, PyObject *args)
+{
+    int result;
+    if (!f_isOpen(self))
+        return NULL;
+    FILE_IO(self, result, call_fileRlsLock(self->fileno));
+    if (result == -1) {
+        PyErr_SetString(file400Error, "rlsLock failed.");
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+PyDoc_STRVAR(enter_doc,
+	     "__enter__() -> self.");
+
+static PyObject *
+File400_self(File400Object *self)
+{
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+static PyMethodDef File400Object_methods[] = {
+    {"open",    (PyCFunction)File400_open,  METH_VARARGS|METH_KEYWORDS, open_doc},
+    {"close",   (PyCFunction)File400_close, METH_VARARGS,close_doc},
+    {"readn",   (PyCFunction)File400_readn, METH_VARARGS, readn_doc},
+    {"readp",   (PyCFunction)File400_readp, METH_VARARGS, readp_doc},
+    {"readrrn",  (PyCFunction)File400_readrrn,METH_VARARGS, readrrn_doc},
+    {"readeq",  (PyCFunction)File400_readeq,METH_VARARGS|METH_KEYWORDS, readeq_doc},
+    {"readne",  (PyCFunction)File400_readne,METH_VARARGS, readne_doc},
+    {"readpe",  (PyCFunction)File400_readpe,METH_VARARGS, readpe_doc},
+    {"readf",   (PyCFunction)File400_readf, METH_VARARGS|METH_KEYWORDS, readf_doc},
+    {"readl",   (PyCFunction)File400_readl, METH_VARARGS|METH_KEYWORDS, readl_doc},
+    {"posa",   (PyCFunction)File400_posa,   METH_VARARGS|METH_KEYWORDS, posa_doc},
+    {"posb",   (PyCFunction)File400_posb,   METH_VARARGS|METH_KEYWORDS, posb_doc},
+    {"posf",    (PyCFunction)File400_posf,  METH_VARARGS|METH_KEYWORDS, posf_doc},
+    {"posl",    (PyCFunction)File400_posl,  METH_VARARGS|METH_KEYWORDS, posl_doc},
+    {"write",   (PyCFunction)File400_write, METH_VARARGS, write_doc},
+    {"delete",  (PyCFunction)File400_delete,METH_VARARGS, delete_doc},
+    {"update",  (PyCFunction)File400_update,METH_VARARGS, update_doc},
+    {"rlsLock", (PyCFunction)File400_rlsLock,METH_VARARGS, rlsLock_doc},
+    {"clear",   (PyCFunction)File400_clear, METH_VARARGS, clear_doc},
+    {"get",     (PyCFunction)File400_get, METH_VARARGS|METH_KEYWORDS, get_doc},
+    {"row",     (PyCFunction)File400_row, METH_VARARGS, row_doc},
+    {"rows",    (PyCFunction)File400_rows, METH_VARARGS|METH_KEYWORDS, rows_doc},
+    {"readmany",(PyCFunction)File400_readmany, METH_VARARGS|METH_KEYWORDS, readmany_doc},
+    {"execute", (PyCFunction)File400_execute, METH_VARARGS, execute_doc},
+    {"prefetch",(PyCFunction)File400_prefetch, METH_VARARGS|METH_KEYWORDS, prefetch_doc},
+    {"selector",(PyCFunction)File400_selector, METH_VARARGS|METH_KEYWORDS, selector_doc},
+    {"writemany",(PyCFunction)File400_writemany, METH_VARARGS, writemany_doc},
+    {"fetch_columns",(PyCFunction)File400_fetch_columns, METH_VARARGS|METH_KEYWORDS, fetch_columns_doc},
+    {"scan",    (PyCFunction)File400_scan, METH_VARARGS|METH_KEYWORDS, scan_doc},
+    {"aggregate",(PyCFunction)File400_aggregate, METH_VARARGS|METH_KEYWORDS, aggregate_doc},
+    {"parallel_scan",(PyCFunction)File400_parallel_scan, METH_VARARGS|METH_KEYWORDS, parallel_scan_doc},
+    {"getBuffer",(PyCFunction)File400_getBuffer, METH_VARARGS, getBuffer_doc},
+    {"getRrn",  (PyCFunction)File400_getRrn, METH_VARARGS, getRrn_doc},
+    {"isOpen",  (PyCFunction)File400_isOpen, METH_VARARGS, isOpen_doc},
+    {"mode",    (PyCFunction)File400_mode,   METH_VARARGS, mode_doc},
+    {"fileName",(PyCFunction)File400_fileName, METH_VARARGS, fileName_doc},
+    {"libName", (PyCFunction)File400_libName, METH_VARARGS, libName_doc},
+    {"fieldCount",(PyCFunction)File400_fieldCount, METH_VARARGS, fieldCount_doc},
+    {"fieldList",(PyCFunction)File400_fieldList, METH_VARARGS, fieldList_doc},
+    {"fieldDesc",(PyCFunction)File400_fieldDesc, METH_VARARGS, fieldDesc_doc},
+    {"fieldSize",(PyCFunction)File400_fieldSize, METH_VARARGS, fieldSize_doc},
+    {"fieldType",(PyCFunction)File400_fieldType, METH_VARARGS, fieldType_doc},
+    {"recordSize",(PyCFunction)File400_recordSize, METH_VARARGS, recordSize_doc},
+    {"keyCount",(PyCFunction)File400_keyCount, METH_VARARGS, keyCount_doc},
+    {"keyList",(PyCFunction)File400_keyList, METH_VARARGS, keyList_doc},
+    {"set", (PyCFunction)File400_set, METH_VARARGS, set_doc},
+    {"setBuffer",(PyCFunction)File400_setBuffer, METH_VARARGS, setBuffer_doc},
+    {"__exit__", (PyCFunction)File400_exit,METH_VARARGS, exit_doc},
+	{"__enter__", (PyCFunction)File400_self,METH_NOARGS, enter_doc},
+    {NULL}       /* sentinel */
+};
+
+static PyObject *
+File400_getattro(File400Object *self, PyObject *nameobj)
+{
+    if (PyUnicode_Check(nameobj)) {
+        if (PyUnicode_READ_CHAR(nameobj, 0) == '_' && PyUnicode_READ_CHAR(nameobj, 1) != '_')
+            return File400_subscript(self, nameobj);
+    }
+    return PyObject_GenericGetAttr((PyObject *)self, nameobj);
+}
+
+static int
+File400_setattro(File400Object *self, PyObject *nameobj, PyObject *v)
+{
+    if (PyUnicode_Check(nameobj)) {
+        if (PyUnicode_READ_CHAR(nameobj, 0) == '_')
+            return File400_ass_subscript(self, nameobj, v);
+    }
+    return -1;
+}
+
+
+/* set flags for fields given in an option, True is all fields, a string one field */
+static int
+f_fieldOption(File400Object *f, PyObject *opt, char *arr, char *errmsg)
+{
+    int i, pos;
+    PyObject *fo, *seq;
+    if (!PyUnicode_Check(opt) && !PySequence_Check(opt)) {
+        memset(arr, 1, f->fi.fieldCount);
+        return 0;
+    }
+    if (PyUnicode_Check(opt))
+        seq = PyTuple_Pack(1, opt);
+    else
+        seq = PySequence_Fast(opt, errmsg);
+    if (seq == NULL)
+        return -1;
+    memset(arr, 0, f->fi.fieldCount);
+    for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        fo = PySequence_Fast_GET_ITEM(seq, i);
+        pos = f_getFieldPos(f, fo);
+        if (pos < 0) {
+            Py_DECREF(seq);
+            PyErr_SetString(file400Error, errmsg);
+            return -1;
+        }
+        arr[pos] = 2;
+    }
+    Py_DECREF(seq);
+    return 0;
+}
+
+/* checksum of saved file description */
+static unsigned int
+f_schemaChecksum(schemaHeader *hd)
+{
+    unsigned char *p = (unsigned char *)&hd->id;
+    unsigned char *e = (unsigned char *)hd + hd->size;
+    unsigned int h = 2166136261u;
+    while (p < e)
+        h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+/* path of the saved description, the name uppercased as the service program has it */
+static void
+f_schemaPath(char *path, int size, FormatId *id, char *name)
+{
+    char upper[11];
+    int i;
+    for (i = 0; i < 10 && name[i] != '\0'; i++)
+        upper[i] = Py_TOUPPER(name[i]);
+    upper[i] = '\0';
+    snprintf(path, size, "%s/%s.%s.f400", schemaDir, id->lib, upper);
+}
+
+/* init from saved file description, returns 0 if done */
+static int
+f_loadSchema(File400Object *f, FormatId *id)
+{
+    char path[1024];
+    int fd, result, size, count;
+    struct stat st;
+    schemaHeader *hd;
+    fieldInfoStruct *fields;
+
+    Py_BEGIN_ALLOW_THREADS
+    result = call_fileGetFormatId(f->fileno, id);
+    Py_END_ALLOW_THREADS
+    if (result < 0) {
+        id->recId[0] = '\0';
+        return -1;
+    }
+    f_schemaPath(path, sizeof(path), id, f->fi.name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(schemaHeader)) {
+        close(fd);
+        return -1;
+    }
+    hd = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hd == MAP_FAILED)
+        return -1;
+    size = st.st_size;
+    count = hd->fi.fieldCount + hd->fi.keyCount;
+    /* check that it is the current format and not damaged */
+    if (memcmp(hd->magic, SCHEMA_MAGIC, 8) || hd->version != SCHEMA_VERSION || hd->size != size ||
+        count < 0 || size != sizeof(schemaHeader) + count * sizeof(fieldInfoStruct) ||
+        strcmp(hd->id.recId, id->recId) || f_schemaChecksum(hd) != hd->checksum) {
+        munmap((void *)hd, size);
+        return -1;
+    }
+    fields = (fieldInfoStruct *)(hd + 1);
+    Py_BEGIN_ALLOW_THREADS
+    result = call_fileSetFormat(f->fileno, &hd->fi, fields, fields + hd->fi.fieldCount, &hd->id);
+    if (!result)
+        result = call_fileGetStruct(f->fileno, &f->fi);
+    Py_END_ALLOW_THREADS
+    if (result < 0) {
+        munmap((void *)hd, size);
+        return -1;
+    }
+    f->fieldArr = PyMem_Malloc(hd->fi.fieldCount * sizeof(fieldInfoStruct) + 1);
+    if (hd->fi.keyCount > 0)
+        f->keyArr = PyMem_Malloc(hd->fi.keyCount * sizeof(fieldInfoStruct));
+    if (f->fieldArr == NULL || (hd->fi.keyCount > 0 && f->keyArr == NULL)) {
+        /* read the description from the file instead */
+        PyMem_Free(f->fieldArr);
+        PyMem_Free(f->keyArr);
+        f->fieldArr = NULL;
+        f->keyArr = NULL;
+        munmap((void *)hd, size);
+        return -1;
+    }
+    memcpy(f->fieldArr, fields, hd->fi.fieldCount * sizeof(fieldInfoStruct));
+    if (hd->fi.keyCount > 0)
+        memcpy(f->keyArr, fields + hd->fi.fieldCount, hd->fi.keyCount * sizeof(fieldInfoStruct));
+    munmap((void *)hd, size);
+    return 0;
+}
+
+/* save file description, written to a temporary file and renamed */
+static void
+f_saveSchema(File400Object *f, FormatId *id)
+{
+    char path[1024], tmp[1040];
+    int fd, size;
+    schemaHeader *hd;
+
+    size = sizeof(schemaHeader) + (f->fi.fieldCount + f->fi.keyCount) * sizeof(fieldInfoStruct);
+    hd = PyMem_Malloc(size);
+    if (hd == NULL)
+        return;
+    memset(hd, 0, sizeof(schemaHeader));
+    memcpy(hd->magic, SCHEMA_MAGIC, 8);
+    hd->version = SCHEMA_VERSION;
+    hd->size = size;
+    hd->id = *id;
+    hd->fi = f->fi;
+    memcpy(hd + 1, f->fieldArr, f->fi.fieldCount * sizeof(fieldInfoStruct));
+    if (f->fi.keyCount > 0)
+        memcpy((fieldInfoStruct *)(hd + 1) + f->fi.fieldCount, f->keyArr,
+               f->fi.keyCount * sizeof(fieldInfoStruct));
+    hd->checksum = f_schemaChecksum(hd);
+    f_schemaPath(path, sizeof(path), id, f->fi.name);
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    fd = mkstemp(tmp);
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+        if (write(fd, hd, size) == size && close(fd) == 0) {
+            if (rename(tmp, path) < 0)
+                unlink(tmp);
+        } else {
+            close(fd);
+            unlink(tmp);
+        }
+    }
+    PyMem_Free(hd);
+}
+
+static int
+f_initFile(File400Object *f)
+{
+    int result, bufsize, saved = 0;
+    char name2[12];
+    PyObject *obj;
+    fieldInfoStruct *fi;
+    fieldInfoStruct *ky;
+    FormatId id;
+
+    id.recId[0] = '\0';
+    if (schemaDir != NULL)
+        saved = (f_loadSchema(f, &id) == 0);
+    if (!saved) {
+        Py_BEGIN_ALLOW_THREADS
+        result = call_fileInit(f->fileno);
+        if (!result)
+            result = call_fileGetStruct(f->fileno, &f->fi);
+        Py_END_ALLOW_THREADS
+        if (result == -1) {
+            PyErr_SetString(file400Error, "File initialization failed.");
+            return -1;
+        }
+        // allocate
+        bufsize = f->fi.fieldCount * sizeof(fieldInfoStruct);
+        f->fieldArr = PyMem_Malloc(bufsize);
+        Py_BEGIN_ALLOW_THREADS
+        result = call_fileGetFields(f->fileno, f->fieldArr, bufsize);
+        Py_END_ALLOW_THREADS
+        if (result == -1) {
+            PyErr_SetString(file400Error, "File initialization failed, getting field information.");
+            return -1;
+        }
+    }
+    fi = f->fieldArr;
+    /* add to dictionary */
+    f->fieldDict = PyDict_New();
+    for (int i = 0; i < f->fi.fieldCount; i++) {
+        Py_INCREF(Py_None);
+        obj = PyLong_FromLong(i);
+        // Save versions of the field name
+        PyDict_SetItemString(f->fieldDict, fi->name, obj);
+        strcpy(name2, fi->name);
+        strtolower(name2);
+        PyDict_SetItemString(f->fieldDict, name2, obj);
+        sprintf(name2, "_%s", fi->name);
+        PyDict_SetItemString(f->fieldDict, name2, obj);
+        strtolower(name2);
+        PyDict_SetItemString(f->fieldDict, name2, obj);
+        Py_DECREF(obj);
+        fi++;
+    }
+    /* get key info */
+    if (f->fi.keyCount > 0) {
+        if (!saved) {
+            bufsize = f->fi.keyCount * sizeof(fieldInfoStruct);
+            f->keyArr = PyMem_Malloc(bufsize);
+            Py_BEGIN_ALLOW_THREADS
+            result = call_fileGetKeyFields(f->fileno, f->keyArr, bufsize);
+            Py_END_ALLOW_THREADS
+            if (result == -1) {
+                PyErr_SetString(file400Error, "File initialization failed, getting key information.");
+                return -1;
+            }
+        }
+        ky = f->keyArr;
+        f->keyDict = PyDict_New();
+        for (int j = 0; j < f->fi.keyCount; j++) {
+            obj = PyDict_GetItemString(f->fieldDict, ky->name);
+            if (obj != NULL) {
+                strcpy(ky->desc, f->fieldArr[PyLong_AS_LONG(obj)].desc);
+                ky->ccsid = f->fieldArr[PyLong_AS_LONG(obj)].ccsid;
+            } else {
+                *ky->desc = '\0';
+                ky->ccsid = 0;
+            }
+            obj = PyLong_FromLong(j);
+            PyDict_SetItemString(f->keyDict, ky->name, obj);
+            sprintf(name2, "_%s", ky->name);
+            PyDict_SetItemString(f->keyDict, name2, obj);
+            Py_DECREF(obj);
+            ky++;
+        }
+    }
+    /* save the description for the next process */
+    if (schemaDir != NULL && !saved && id.recId[0] != '\0')
+        f_saveSchema(f, &id);
+    /* fields to return as Decimal */
+    if (f->decimal != NULL && PyObject_IsTrue(f->decimal) == 1) {
+        f->decArr = PyMem_Malloc(f->fi.fieldCount);
+        if (f->decArr == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (f_fieldOption(f, f->decimal, f->decArr, "Decimal field not valid.") < 0)
+            return -1;
+        if (f_decimalType() == NULL)
+            return -1;
+    }
+    /* compile the decode plan */
+    f->plan = PyMem_Malloc(f->fi.fieldCount * sizeof(fieldPlan));
+    if (f->plan == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (int i = 0; i < f->fi.fieldCount; i++)
+        f_planField(&f->plan[i], &f->fieldArr[i], (f->decArr != NULL && f->decArr[i]));
+    /* string caches, automatic for short char fields or the fields given */
+    if (f->cache != NULL && PyObject_IsTrue(f->cache) == 1) {
+        char *cacheArr = PyMem_Malloc(f->fi.fieldCount);
+        if (cacheArr == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (f_fieldOption(f, f->cache, cacheArr, "Cache field not valid.") < 0) {
+            PyMem_Free(cacheArr);
+            return -1;
+        }
+        for (int i = 0; i < f->fi.fieldCount; i++) {
+            if (f->fieldArr[i].type != 4 || f->plan[i].cvt == cvt_bytes)
+                continue;
+            if (cacheArr[i] == 2 || (cacheArr[i] == 1 && f->fieldArr[i].len <= STRCACHE_MAXLEN))
+                f_planCache(&f->plan[i], (cacheArr[i] == 1));
+        }
+        PyMem_Free(cacheArr);
+    }
+    // allocate storage for record
+    f->recbuf = PyMem_Malloc(f->fi.recLen + 1);
+    if (f->recbuf == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    // clear the record
+    f_clear(f, f->recbuf);
+    /* return ok */
+    return 0;
+}
+
+/* free what a failed initialization left, the next use starts over */
+static void
+f_initReset(File400Object *f)
+{
+    if (f->fieldArr) PyMem_Free(f->fieldArr);
+    if (f->keyArr) PyMem_Free(f->keyArr);
+    if (f->decArr) PyMem_Free(f->decArr);
+    f_freePlan(f);
+    Py_CLEAR(f->fieldDict);
+    Py_CLEAR(f->keyDict);
+    f->fieldArr = NULL;
+    f->keyArr = NULL;
+    f->decArr = NULL;
+}
+
+static int
+file400_initFile(File400Object *f)
+{
+    int result = 0;
+    f_lock(f);
+    /* another thread may have opened the file while we waited */
+    if (f->recbuf == NULL) {
+        result = f_initFile(f);
+        if (result < 0)
+            f_initReset(f);
+    }
+    PyThread_release_lock(f->lock);
+    return result;
+}
+
+char File400_doc[] =
+"File400(Filename[mode, lib, mbr]) -> File400 Object\n\
+\n\
+Creates a new File400 Object.\n\
+Filename must exist.\n\
+mode - Open mode\n\
+    None - (default) read.\n\
+    'r'  - open for read.\n\
+    'a'  - open for append.\n\
+    'r+' - open for read, update and append.\n\
+lib     - Library, special values are *LIBL(default) and *CURLIB.\n\
+member  - Member to be opened, special value are *FIRST(default).\n\
+decimal - Return zoned and packed fields with decimals as Decimal\n\
+          instead of float. True for all fields, a field or a sequence of fields.\n\
+cache   - Reuse the string objects of char fields with few distinct values.\n\
+          True for all short char fields, a field or a sequence of fields.\n\
 \n\
 Methodes:\n\
   open       - Open file.\n\
@@ -2674,6 +7510,11 @@ Methodes:\n\
   rlsLock    - Release lock on current record.\n\
   clear      - Clear the record buffer.\n\
   get        - Get values from record buffer.\n\
+  row        - Get record buffer as a Row, fields converted when used.\n\
+  rows       - Iterate over records as Row objects.\n\
+  readmany   - Read many records as Row objects in one call.\n\
+  fetch_columns - Read many records as columns.\n\
+  scan       - Iterate over a key range.\n\
   getRrn     - Get relative record number.\n\
   mode       - Returns open mode (r, a, r+).\n\
   fileName   - Returns Name of the file.\n\
@@ -2689,6 +7530,12 @@ Methodes:\n\
   set        - Set field values into record buffer.\n\
   setKey     - Set key values into key buffer.\n\
 \n\
+memoryview(f) gives the record buffer without copy, read only when the\n\
+file is opened for read. The file can not be closed while in use.\n\
+\n\
+Record i/o runs without the GIL, so other threads can run meanwhile.\n\
+Only one thread at a time is in the service program for a File400 object.\n\
+\n\
 See the __doc__ string on each method for details.\n\
 >>> f = File400('YOURFILE')\n\
 >>> print f.open__doc__";
@@ -2700,11 +7547,12 @@ File400_new(PyTypeObject *type, PyObject *args, PyObject *keywds)
     char *lib = "*LIBL";
     char *mbr = "*FIRST";
     int omode;
-    static char *kwlist[] = {"file", "mode", "lib", "mbr", NULL};
-    PyObject *mode = Py_None;
+    static char *kwlist[] = {"file", "mode", "lib", "mbr", "decimal", "cache", NULL};
+    PyObject *mode = Py_None, *decimal = Py_None, *cache = Py_None;
     File400Object *nf;
 
-    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|Oss:File400", kwlist, &file, &mode, &lib, &mbr))
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "s|OssOO:File400", kwlist, &file, &mode, &lib, &mbr,
+                                     &decimal, &cache))
         return NULL;
     if (strlen(file) > 10 || strlen(lib) > 10 || strlen(mbr) > 10) {
         PyErr_SetString(file400Error, "File,Lib and Member have max length of 10.");
@@ -2744,7 +7592,22 @@ File400_new(PyTypeObject *type, PyObject *args, PyObject *keywds)
     nf->keyArr = NULL;
     nf->fieldDict = NULL;
     nf->keyDict = NULL;
+    nf->decArr = NULL;
+    nf->plan = NULL;
+    Py_INCREF(decimal);
+    nf->decimal = decimal;
+    Py_INCREF(cache);
+    nf->cache = cache;
     nf->recbuf = NULL;
+    nf->exports = 0;
+    nf->prefetch = NULL;
+    nf->pflock = NULL;
+    nf->lock = PyThread_allocate_lock();
+    if (nf->lock == NULL) {
+        Py_DECREF(nf);
+        PyErr_SetString(file400Error, "Can not allocate lock.");
+        return NULL;
+    }
     return (PyObject *) nf;
 }
 
@@ -2762,6 +7625,25 @@ setFieldtype(PyObject* self, PyObject* args)
     return Py_None;
 }
 
+static PyObject *
+setSchemaCache(PyObject *self, PyObject *args)
+{
+    char *dir = NULL;
+    if (!PyArg_ParseTuple(args, "z:setSchemaCache", &dir))
+        return NULL;
+    if (schemaDir != NULL)
+        PyMem_RawFree(schemaDir);
+    schemaDir = NULL;
+    if (dir != NULL && *dir != '\0') {
+        schemaDir = PyMem_RawMalloc(strlen(dir) + 1);
+        if (schemaDir == NULL)
+            return PyErr_NoMemory();
+        strcpy(schemaDir, dir);
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
 static PyObject *
 run_system(File400Object *self, PyObject *args)
 {
@@ -2773,6 +7655,35 @@ run_system(File400Object *self, PyObject *args)
     return PyLong_FromLong(result);
 }
 
+static PyObject *
+setPool(PyObject *self, PyObject *args, PyObject *keywds)
+{
+    int size, idle = 300;
+    static char *kwlist[] = {"size", "idle", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, keywds, "i|i:setPool", kwlist, &size, &idle))
+        return NULL;
+    if (size < 0) {
+        PyErr_SetString(file400Error, "Pool size not valid.");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    call_poolConfig(size, idle);
+    Py_END_ALLOW_THREADS
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+static PyObject *
+poolStats(PyObject *self, PyObject *args)
+{
+    int stats[6];
+    if (!PyArg_ParseTuple(args, ":poolStats"))
+        return NULL;
+    call_poolStats(stats);
+    return Py_BuildValue("{s:i,s:i,s:i,s:i,s:i,s:i}", "hits", stats[0], "misses", stats[1],
+                         "evicted", stats[2], "pooled", stats[3], "size", stats[4], "idle", stats[5]);
+}
+
 PyTypeObject File400_Type = {
     PyVarObject_HEAD_INIT(NULL, 0)
     .tp_name = "File400",
@@ -2780,6 +7691,7 @@ PyTypeObject File400_Type = {
     .tp_basicsize = sizeof(File400Object),
     .tp_dealloc = (destructor)File400_dealloc,
     .tp_as_mapping = &File400_as_mapping,
+    .tp_as_buffer = &File400_as_buffer,
     .tp_getattro = (getattrofunc)File400_getattro,
     .tp_setattro = (setattrofunc)File400_setattro,
 	.tp_flags = Py_TPFLAGS_DEFAULT,
@@ -2793,6 +7705,14 @@ PyTypeObject File400_Type = {
 static PyMethodDef file400_memberlist[] = {
     {"setFieldtypeFunction", (PyCFunction)setFieldtype, METH_VARARGS, "Set factory function for field types."},
     {"system", (PyCFunction)run_system, METH_VARARGS, "Run command."},
+    {"setSchemaCache", (PyCFunction)setSchemaCache, METH_VARARGS,
+     "setSchemaCache(dir) - Save file descriptions in dir, None to stop.\n"
+     "Default from environment variable PY3FILE400CACHE."},
+    {"setPool", (PyCFunction)setPool, METH_VARARGS|METH_KEYWORDS,
+     "setPool(size, idle=300) - Keep up to size closed files open for reuse,\n"
+     "closed after idle seconds unused. Size 0 stops pooling."},
+    {"poolStats", (PyCFunction)poolStats, METH_VARARGS,
+     "poolStats() - Pool counters as a dictionary."},
     {NULL}
 };
 
@@ -2811,7 +7731,9 @@ PyInit_file400(void)
     PyObject *m;
     char *lib;
     /* Create the module and add the functions */
-	if (PyType_Ready(&File400_Type) < 0) {
+	if (PyType_Ready(&File400_Type) < 0 || PyType_Ready(&Row_Type) < 0 ||
+	    PyType_Ready(&RowIter_Type) < 0 || PyType_Ready(&Column_Type) < 0 ||
+	    PyType_Ready(&Scan_Type) < 0 || PyType_Ready(&Selector_Type) < 0) {
         Py_FatalError("Failed in File400 type ready");
 		return NULL;
 	}
@@ -2821,6 +7743,12 @@ PyInit_file400(void)
     PyModule_AddObject(m, "Error", file400Error);
     Py_INCREF(&File400_Type);
     PyModule_AddObject(m, "File400", (PyObject *)&File400_Type);
+    Py_INCREF(&Row_Type);
+    PyModule_AddObject(m, "Row", (PyObject *)&Row_Type);
+    Py_INCREF(&Column_Type);
+    PyModule_AddObject(m, "Column", (PyObject *)&Column_Type);
+    Py_INCREF(&Selector_Type);
+    PyModule_AddObject(m, "Selector", (PyObject *)&Selector_Type);
     if (PyErr_Occurred() ) {
         Py_FatalError("Can not initialize file400");
 		return NULL;
@@ -2830,6 +7758,12 @@ PyInit_file400(void)
         strncpy(reclevacc_lib, lib, 10);
     else
         strcpy(reclevacc_lib, "PYTHON3");
+    lib = getenv("PY3FILE400CACHE");
+    if (lib && *lib) {
+        schemaDir = PyMem_RawMalloc(strlen(lib) + 1);
+        if (schemaDir)
+            strcpy(schemaDir, lib);
+    }
     fileRowClass = PyObject_CallFunctionObjArgs((PyObject *)&PyType_Type, PyUnicode_FromString("FileRow"),
          PyTuple_New(0), PyDict_New(), NULL);
 	// return module
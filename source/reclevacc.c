@@ -28,6 +28,8 @@
  * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define _MULTI_THREADED
+#include <pthread.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <errno.h>
@@ -37,13 +39,47 @@
 #include <iconv.h>
 #include <qtqiconv.h>
 #include <float.h>
+#include <time.h>
 #include <recio.h>
 
 /* Open modes */
 #define OPEN_READ 10
 #define OPEN_UPDATE 12
 #define OPEN_WRITE 14
-#define _FILE_MAX 2048
+#define OPEN_ARRIVAL 16		/* read in arrival sequence */
+/* handles, index in the low bits and generation in the high bits */
+#define HANDLE_BITS 20
+#define HANDLE_MAX (1 << HANDLE_BITS)
+#define HANDLE_CHUNK 256
+#define HANDLE_GEN_MASK 0x7ff
+/* batch commands, reads use the read operation codes */
+#define CMD_POSB 31
+#define CMD_POSA 32
+#define CMD_POSF 33
+#define CMD_POSL 34
+#define CMD_READEQ 41
+#define CMD_READRRN 42
+#define CMD_WRITE 51
+#define CMD_UPDATE 52
+#define CMD_DELETE 53
+#define CMD_RLSLOCK 54
+/* predicate operators */
+#define PRED_EQ 1
+#define PRED_NE 2
+#define PRED_LT 3
+#define PRED_LE 4
+#define PRED_GT 5
+#define PRED_GE 6
+#define PRED_IN 7
+#define PRED_BETWEEN 8
+#define PRED_FALSE 9
+/* aggregates and aggregate state */
+#define AGG_SUM 1
+#define AGG_MIN 2
+#define AGG_MAX 3
+#define AGG_READ 0
+#define AGG_END 1
+#define AGG_DONE 2
 /* Field information structure */
 typedef struct {
 	char name[11];
@@ -66,8 +102,7 @@ typedef struct {
 	char      mbr[11];
 	int       omode;
 	int       lmode;
-	char      *recbuf;	/* record buffer */
-	char      *tmpbuf;	/* record buffer */
+	char      *recbuf;	/* cleared record for fileClear/fileGetData */
 	char      *keybuf;	/* key buffer */
 	char      recName[11];
 	char      recId[14];
@@ -78,8 +113,98 @@ typedef struct {
 	int       curKeyLen;
 	fieldInfoStruct *fieldArr;
 	fieldInfoStruct *keyArr;
+	struct FormatInfoStruct *fmt;	/* shared format, owns fieldArr and keyArr */
 } IntFileInfo;
 
+/* Record format information, shared by all handles of the file */
+typedef struct FormatInfoStruct {
+	char      name[11];
+	char      lib[11];	/* library where the file was found */
+	char      recName[11];
+	char      recId[14];	/* format level identifier */
+	int       recLen;
+	int       keyLen;
+	int       fieldCount;
+	int       keyCount;
+	fieldInfoStruct *fieldArr;
+	fieldInfoStruct *keyArr;
+	int       refCount;	/* handles using the format */
+	int       cached;	/* in formatList */
+	struct FormatInfoStruct *next;
+} FormatInfo;
+
+/* Format identification, from the header of the file description */
+typedef struct {
+	char      lib[11];
+	char      recName[11];
+	char      recId[14];
+} FormatId;
+
+/* Batch command, followed by size bytes of key or field patches */
+typedef struct {
+	short     oper;
+	short     lock;
+	int       arg;	/* key length, rrn or number of patches */
+	int       size;	/* a multiple of 4 */
+} CmdHead;
+
+/* Field patch for write and update, followed by len bytes rounded to 4 */
+typedef struct {
+	int       offset;
+	int       len;
+} CmdPatch;
+
+/* Predicate program, followed by the end key and the conditions */
+typedef struct {
+	int       size;	/* size of the program */
+	int       count;	/* number of conditions, all must be true */
+	int       endCnt;	/* key fields in the end key, 0 if none */
+	int       endLen;	/* length of the end key, rounded to 4 */
+} PredProgram;
+
+/* Condition, followed by count values in the field format, each rounded to 4 */
+typedef struct {
+	short     op;
+	short     count;
+	int       field;	/* position in fieldArr */
+	int       size;	/* bytes of values */
+} PredCond;
+
+/*
+ * Aggregate spec, followed by the aggregates and the open group.
+ * A group is the group key, the record count and the aggregate values.
+ */
+typedef struct {
+	int       size;	/* size of the spec */
+	int       count;	/* number of aggregates */
+	int       groupLen;	/* length of the group key, the first key fields */
+	int       countOffset;	/* offset of the record count in a group */
+	int       outLen;	/* size of a group */
+	int       curOffset;	/* offset of the open group in the spec */
+	int       state;	/* AGG_READ, AGG_END when read to the end, AGG_DONE */
+	int       reserved;
+} AggSpec;
+
+typedef struct {
+	short     op;
+	short     reserved;
+	int       field;	/* position in fieldArr */
+	int       offset;	/* offset of the value in a group */
+	int       len;	/* 16 for a sum, field length for min and max */
+} AggDef;
+
+/* Open data path kept for reuse */
+typedef struct PoolEntryStruct {
+	char      name[11];
+	char      lib[11];
+	char      mbr[11];
+	int       omode;
+	char      recId[14];
+	_RFILE    *fp;
+	time_t    since;	/* when it was returned to the pool */
+	struct PoolEntryStruct *next;
+} PoolEntry;
+
 /* Internal File info */
 typedef struct {
 	char     name[11];
@@ -97,14 +222,72 @@ typedef struct {
     _RFILE    *fp;
 } FileHead;
 
-static FileHead *fileArr[_FILE_MAX] = {NULL};
-/* hold utf conversion descriptors */
-static int utfInit = 0;
+/* Handle table slot */
+typedef struct {
+    FileHead *fh;
+    int       gen;      /* generation, changed when the slot is freed */
+    int       next;     /* next free slot */
+} HandleSlot;
+
+/*
+ * The service program can be called from many threads.
+ * The handle table is only changed with handleMutex held. It grows in
+ * chunks that never move, freed slots are reused last in first out.
+ * A handle is owned by one thread at a time, the caller serializes
+ * the use of each handle (file400 holds a lock per File400 object).
+ */
+static HandleSlot *handleDir[HANDLE_MAX / HANDLE_CHUNK] = {NULL};
+static int handleCount = 0;     /* slots in use or on the free list */
+static int handleFree = -1;     /* first free slot */
+static pthread_mutex_t handleMutex = PTHREAD_MUTEX_INITIALIZER;
+/* hold utf conversion descriptors, iconv keeps state so one user at a time */
+static pthread_once_t utfOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t utfMutex = PTHREAD_MUTEX_INITIALIZER;
 static iconv_t cdToUtf;
 static iconv_t cdFromUtf;
+/* cached record formats */
+static FormatInfo *formatList = NULL;
+static pthread_mutex_t formatMutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Pool of open data paths, most recently returned first.
+ * Not used until poolConfig sets a size. Limits are checked when the
+ * pool is used, files are closed without the mutex held.
+ */
+static PoolEntry *poolList = NULL;
+static int poolCount = 0;
+static int poolMax = 0;         /* max files in the pool */
+static int poolIdle = 300;      /* seconds before an unused file is closed */
+static int poolHits = 0;
+static int poolMisses = 0;
+static int poolEvicted = 0;
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
 
 int fileInit(int fileno);
 int fileOpen(int fileno);
+int fileWrite(int fileno, char *buf);
+int fileUpdate(int fileno, char *buf);
+int fileDelete(int fileno);
+
+#define f_slot(index) (&handleDir[(index) / HANDLE_CHUNK][(index) % HANDLE_CHUNK])
+
+/* get file from handle, NULL if the handle is not valid or freed */
+static FileHead *
+f_getHead(int fileno)
+{
+    FileHead *fh = NULL;
+    HandleSlot *slot;
+    int index = fileno & (HANDLE_MAX - 1);
+    if (fileno < 0)
+        return NULL;
+    pthread_mutex_lock(&handleMutex);
+    if (index < handleCount) {
+        slot = f_slot(index);
+        if (slot->gen == (fileno >> HANDLE_BITS))
+            fh = slot->fh;
+    }
+    pthread_mutex_unlock(&handleMutex);
+    return fh;
+}
 
 // Init an open if not already done
 #pragma inline(f_init)
@@ -134,6 +317,109 @@ f_open(FileHead *fh) {
     return 0;
 }
 
+/* unlink the entries over the limits, returns them for closing */
+static PoolEntry *
+f_poolTrim(time_t now)
+{
+    PoolEntry **pp = &poolList;
+    PoolEntry *e, *old = NULL;
+    int n = 0;
+    while ((e = *pp) != NULL) {
+        if (++n > poolMax || (poolIdle > 0 && now - e->since > poolIdle)) {
+            *pp = e->next;
+            e->next = old;
+            old = e;
+            poolCount--;
+            poolEvicted++;
+        } else
+            pp = &e->next;
+    }
+    return old;
+}
+
+static void
+f_poolClose(PoolEntry *e)
+{
+    PoolEntry *next;
+    for (; e != NULL; e = next) {
+        next = e->next;
+        _Rclose(e->fp);
+        free(e);
+    }
+}
+
+/* take an open of the same file, member, mode and format from the pool */
+static _RFILE *
+f_poolGet(IntFileInfo *fi)
+{
+    PoolEntry **pp, *e, *old;
+    _RFILE *fp = NULL;
+
+    if (poolMax == 0)
+        return NULL;
+    pthread_mutex_lock(&poolMutex);
+    old = f_poolTrim(time(NULL));
+    for (pp = &poolList; (e = *pp) != NULL; pp = &e->next) {
+        if (e->omode == fi->omode && !strcmp(e->name, fi->name) && !strcmp(e->lib, fi->lib) &&
+            !strcmp(e->mbr, fi->mbr) && !strcmp(e->recId, fi->recId)) {
+            *pp = e->next;
+            poolCount--;
+            break;
+        }
+    }
+    if (e != NULL)
+        poolHits++;
+    else
+        poolMisses++;
+    pthread_mutex_unlock(&poolMutex);
+    f_poolClose(old);
+    if (e != NULL) {
+        fp = e->fp;
+        free(e);
+    }
+    return fp;
+}
+
+/* return an open file to the pool, -1 if the caller has to close it */
+static int
+f_poolPut(IntFileInfo *fi, _RFILE *fp)
+{
+    PoolEntry *e, *old;
+
+    if (poolMax == 0 || fi->recId[0] == '\0')
+        return -1;
+    e = malloc(sizeof(PoolEntry));
+    if (e == NULL)
+        return -1;
+    /* the next user starts without locks or buffered records */
+    if (fi->omode == OPEN_UPDATE)
+        _Rrlslck(fp);
+    if (fi->omode == OPEN_WRITE && _Rfeod(fp) < 0) {
+        free(e);
+        return -1;
+    }
+    strcpy(e->name, fi->name);
+    strcpy(e->lib, fi->lib);
+    strcpy(e->mbr, fi->mbr);
+    strcpy(e->recId, fi->recId);
+    e->omode = fi->omode;
+    e->fp = fp;
+    e->since = time(NULL);
+    pthread_mutex_lock(&poolMutex);
+    if (poolMax == 0) {
+        pthread_mutex_unlock(&poolMutex);
+        free(e);
+        return -1;
+    }
+    e->next = poolList;
+    poolList = e;
+    poolCount++;
+    old = f_poolTrim(e->since);
+    pthread_mutex_unlock(&poolMutex);
+    f_poolClose(old);
+    return 0;
+}
+
 /* returns conversion descriptors  */
 static iconv_t
 initConvert(int fromccsid, int toccsid) {
@@ -150,7 +436,6 @@ initUtf(void)
 {
     cdFromUtf = initConvert(1208, 0);
     cdToUtf = initConvert(0, 1208);
-    utfInit = 1;
 }
 
 /* convert as/400 string to utf, returns length not including ending NULL */
@@ -169,11 +454,13 @@ strLenToUtf(char *in, int len, char *out)
         *out = '\0';
         return 0;
     }
-    if (utfInit == 0) initUtf();
+    pthread_once(&utfOnce, initUtf);
     p1 = in;
     p2 = out;
     sizeto = len;
+    pthread_mutex_lock(&utfMutex);
     iconv(cdToUtf, &p1, &sizefrom, &p2, &sizeto);
+    pthread_mutex_unlock(&utfMutex);
     if (errno == E2BIG)
         errno = 0;
     *p2 = '\0';
@@ -187,12 +474,14 @@ utfToStrLen(char *in, char *out, int len, int add_null)
     char *__ptr128 p1, *__ptr128 p2;
     size_t sizefrom, sizeto;
     if (*in != '\0') {
-        if (utfInit == 0) initUtf();
+        pthread_once(&utfOnce, initUtf);
         p1 = in;
         p2 = out;
         sizefrom = strlen(in);
         sizeto = len;
+        pthread_mutex_lock(&utfMutex);
         iconv(cdFromUtf, &p1, &sizefrom, &p2, &sizeto);
+        pthread_mutex_unlock(&utfMutex);
         if (errno == E2BIG)
             errno = 0;
         if (sizeto > 0)
@@ -255,97 +544,199 @@ int float2packed(char *buf, int len, int dec, double value) {
 }
 
 int fileNew(char *name, char *lib, char *mbr, int mode) {
-    int fileno;
+    int fileno, index;
     FileHead *fh;
     IntFileInfo *fi;
+    HandleSlot *slot;
 
-    for (fileno=0; fileno < _FILE_MAX; fileno++) {
-        fh = fileArr[fileno];
-        if (fh == NULL) {
-            fh = malloc(sizeof(FileHead));
-            fh->fi = malloc(sizeof(IntFileInfo));
-            fh->fp = NULL;
-            fi = fh->fi;
-            fi->fileno = fileno;
-            fileArr[fileno] = fh;
-            break;
+    pthread_mutex_lock(&handleMutex);
+    if (handleFree >= 0) {
+        index = handleFree;
+        slot = f_slot(index);
+        handleFree = slot->next;
+    } else {
+        if (handleCount == HANDLE_MAX) {
+            pthread_mutex_unlock(&handleMutex);
+            fprintf(stderr, "Maximum number of open files reached\n");
+            return -1;
         }
+        index = handleCount;
+        if (handleDir[index / HANDLE_CHUNK] == NULL) {
+            handleDir[index / HANDLE_CHUNK] = calloc(HANDLE_CHUNK, sizeof(HandleSlot));
+            if (handleDir[index / HANDLE_CHUNK] == NULL) {
+                pthread_mutex_unlock(&handleMutex);
+                fprintf(stderr, "No storage for file handle\n");
+                return -1;
+            }
+        }
+        handleCount++;
+        slot = f_slot(index);
     }
-    if (fileno == _FILE_MAX) {
-        fprintf(stderr, "Maximum number of open files reached\n");
-        return -1;
-    }
+    fh = malloc(sizeof(FileHead));
+    fh->fi = malloc(sizeof(IntFileInfo));
+    fh->fp = NULL;
+    fi = fh->fi;
+    fileno = (slot->gen << HANDLE_BITS) | index;
+    fi->fileno = fileno;
+    slot->fh = fh;
+    pthread_mutex_unlock(&handleMutex);
     strtoupper(strcpy(fi->name, name));
     strtoupper(strcpy(fi->lib, lib));
     strtoupper(strcpy(fi->mbr, mbr));
     fi->lmode = -1;
     fi->omode = mode;
     fi->recbuf = NULL;
-    fi->tmpbuf = NULL;
     fi->keybuf = NULL;
     fi->fieldArr = NULL;
     fi->keyArr = NULL;
+    fi->fmt = NULL;
     return fileno;
 }
 
-int fileInit(int fileno) {
+/* new handle for the same member, opened in mode on first use */
+int fileDup(int fileno, int mode) {
     FileHead *fh;
-    IntFileInfo *fi;
-    char *p, retFileLib[20], fileLib[21];
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    return fileNew(fh->fi->name, fh->fi->lib, fh->fi->mbr, mode);
+}
+
+/* find cached format and add a reference, NULL if not cached */
+static FormatInfo *
+f_findFormat(char *lib, char *name, char *recId)
+{
+    FormatInfo *fmt;
+    pthread_mutex_lock(&formatMutex);
+    for (fmt = formatList; fmt != NULL; fmt = fmt->next) {
+        if (!strcmp(fmt->recId, recId) && !strcmp(fmt->name, name) && !strcmp(fmt->lib, lib)) {
+            fmt->refCount++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&formatMutex);
+    return fmt;
+}
+
+static void
+f_freeFormat(FormatInfo *fmt)
+{
+    if (fmt->fieldArr) free(fmt->fieldArr);
+    if (fmt->keyArr) free(fmt->keyArr);
+    free(fmt);
+}
+
+/* add format to the cache, formats of the file with another level id are dropped */
+static FormatInfo *
+f_addFormat(FormatInfo *new)
+{
+    FormatInfo *fmt, **prev;
+    pthread_mutex_lock(&formatMutex);
+    prev = &formatList;
+    while ((fmt = *prev) != NULL) {
+        if (!strcmp(fmt->name, new->name) && !strcmp(fmt->lib, new->lib)) {
+            /* added by another thread meanwhile */
+            if (!strcmp(fmt->recId, new->recId)) {
+                fmt->refCount++;
+                pthread_mutex_unlock(&formatMutex);
+                f_freeFormat(new);
+                return fmt;
+            }
+            /* format changed, freed when the last handle is freed */
+            *prev = fmt->next;
+            fmt->cached = 0;
+            if (fmt->refCount == 0)
+                f_freeFormat(fmt);
+            continue;
+        }
+        prev = &fmt->next;
+    }
+    new->refCount = 1;
+    new->cached = 1;
+    new->next = formatList;
+    formatList = new;
+    pthread_mutex_unlock(&formatMutex);
+    return new;
+}
+
+/* release a reference, the format stays cached unless it is replaced */
+static void
+f_releaseFormat(FormatInfo *fmt)
+{
+    int drop;
+    pthread_mutex_lock(&formatMutex);
+    fmt->refCount--;
+    drop = (fmt->refCount == 0 && !fmt->cached);
+    pthread_mutex_unlock(&formatMutex);
+    if (drop)
+        f_freeFormat(fmt);
+}
+
+/* read field and key information, qualName is file and library in ebcdic */
+static FormatInfo *
+f_loadFormat(char *qualName, int fibuffsize)
+{
+    FormatInfo *fmt;
+    char *p, retFileLib[20];
     Qus_EC_t error;
     Qdb_Qddfmt_t *foHd;
     Qdb_Qddffld_t *fiHd;
     Qdb_Qdbwh_t *kyHd;
     Qdb_Qdbwhkey_t *kyKey;
-    char *fibuff, *kibuff;
-    int i, size, fibuffsize;
+    char *fibuff, *kibuff, *nbuff;
+    int i;
     fieldInfoStruct *fieldInfo;
     fieldInfoStruct *keyInfo;
 
-    // Get file structure
-    fh = fileArr[fileno];
-    fi = fh->fi;
-    // File information
     error.Bytes_Provided = sizeof(error);
-    //
-    // File information
-    utfToStrLen(fi->name, fileLib, 10, 0);
-    utfToStrLen(fi->lib, fileLib + 10, 10, 1);
-    fibuff = malloc(100000);
-    fibuffsize = 100000;
-#pragma convert(37)
-    QDBRTVFD(fibuff, fibuffsize, retFileLib, "FILD0200", fileLib,
-                 "*FIRST    ", "0", "*LCL      ", "*EXT      ", &error);
-#pragma convert(0)
-    if (error.Bytes_Available > 0) {
+    fmt = calloc(1, sizeof(FormatInfo));
+    /* the size is known from the header */
+    fibuff = malloc(fibuffsize);
+    if (fmt == NULL || fibuff == NULL) {
         free(fibuff);
-        return -1;
+        free(fmt);
+        return NULL;
     }
-    foHd = (Qdb_Qddfmt_t *) fibuff;
-    if (foHd->Qddbyava > fibuffsize) {
-        fibuffsize = foHd->Qddbyava;
-        fibuff = realloc(fibuff, fibuffsize);
+    for (;;) {
 #pragma convert(37)
-        QDBRTVFD(fibuff, fibuffsize, retFileLib, "FILD0200", fileLib,
-                 "          ", "0", "*LCL      ", "*EXT      ", &error);
+        QDBRTVFD(fibuff, fibuffsize, retFileLib, "FILD0200", qualName,
+                 "*FIRST    ", "0", "*LCL      ", "*EXT      ", &error);
 #pragma convert(0)
         if (error.Bytes_Available > 0) {
             free(fibuff);
-            return -1;
+            free(fmt);
+            return NULL;
         }
         foHd = (Qdb_Qddfmt_t *) fibuff;
+        /* the file was changed after the header was read, call again */
+        if (foHd->Qddbyava <= fibuffsize)
+            break;
+        fibuffsize = foHd->Qddbyava;
+        nbuff = realloc(fibuff, fibuffsize);
+        if (nbuff == NULL) {
+            free(fibuff);
+            free(fmt);
+            return NULL;
+        }
+        fibuff = nbuff;
     }
     /* get record info */
-    strLenToUtf(retFileLib + 10, 10, fi->lib);
-    strLenToUtf(foHd->Qddfname, 10, fi->recName);
-    strLenToUtf(foHd->Qddfseq, 13, fi->recId);
-    fi->recLen = foHd->Qddfrlen;
+    strLenToUtf(retFileLib, 10, fmt->name);
+    strLenToUtf(retFileLib + 10, 10, fmt->lib);
+    strLenToUtf(foHd->Qddfname, 10, fmt->recName);
+    strLenToUtf(foHd->Qddfseq, 13, fmt->recId);
+    fmt->recLen = foHd->Qddfrlen;
     /* get field info */
-    fi->fieldCount = foHd->Qddffldnum;
-    fi->fieldArr = fieldInfo = malloc(fi->fieldCount * sizeof(fieldInfoStruct));
+    fmt->fieldCount = foHd->Qddffldnum;
+    fmt->fieldArr = fieldInfo = malloc(fmt->fieldCount * sizeof(fieldInfoStruct));
+    if (fieldInfo == NULL) {
+        free(fibuff);
+        free(fmt);
+        return NULL;
+    }
     p = fibuff + sizeof(Qdb_Qddfmt_t);
     fiHd = (Qdb_Qddffld_t *) p;
-    for (i = 0; i < fi->fieldCount; i++) {
+    for (i = 0; i < fmt->fieldCount; i++) {
         strLenToUtf(fiHd->Qddffldi, 10, fieldInfo->name);
         memcpy(&fieldInfo->type, fiHd->Qddfftyp, 2);
         fieldInfo->offset = fiHd->Qddffobo;
@@ -365,47 +756,62 @@ int fileInit(int fileno) {
     /* free allocated storage */
     free(fibuff);
     // Key field information
-    fi->keyCount = 0;
-    fi->keyLen = 0;
-    fi->curKeyLen = 0;
+    fmt->keyCount = 0;
+    fmt->keyLen = 0;
     kibuff = malloc(1024);
+    if (kibuff == NULL) {
+        f_freeFormat(fmt);
+        return NULL;
+    }
 #pragma convert(37)
-    QDBRTVFD(kibuff, 1024, retFileLib, "FILD0300", fileLib,
+    QDBRTVFD(kibuff, 1024, retFileLib, "FILD0300", qualName,
              "          ", "0", "*LCL      ", "*EXT      ", &error);
 #pragma convert(0)
     if (error.Bytes_Available == 0) {
         kyHd = (Qdb_Qdbwh_t *) kibuff;
         if (kyHd->Byte_Avail > 1024) {
-            kibuff = realloc(kibuff, kyHd->Byte_Avail);
+            nbuff = realloc(kibuff, kyHd->Byte_Avail);
+            if (nbuff == NULL) {
+                free(kibuff);
+                f_freeFormat(fmt);
+                return NULL;
+            }
+            kibuff = nbuff;
             kyHd = (Qdb_Qdbwh_t *) kibuff;
     #pragma convert(37)
-            QDBRTVFD(kibuff, kyHd->Byte_Avail, retFileLib, "FILD0300", fileLib,
+            QDBRTVFD(kibuff, kyHd->Byte_Avail, retFileLib, "FILD0300", qualName,
                      "          ", "0", "*LCL      ", "*EXT      ", &error);
     #pragma convert(0)
             if (error.Bytes_Available > 0) {
                 free(kibuff);
-                return -1;
+                f_freeFormat(fmt);
+                return NULL;
             }
         }
         p = kibuff;
         /* find offset to first record format */
-        fi->keyCount = kyHd->Rec_Key_Info->Num_Of_Keys;
-        if (fi->keyCount > 0) {
+        fmt->keyCount = kyHd->Rec_Key_Info->Num_Of_Keys;
+        if (fmt->keyCount > 0) {
             p += kyHd->Rec_Key_Info->Key_Info_Offset;
             kyKey = (Qdb_Qdbwhkey_t *) p;
-            fi->keyArr = keyInfo = malloc(fi->keyCount * sizeof(fieldInfoStruct));
-            for (int j = 0; j < fi->keyCount; j++) {
+            fmt->keyArr = keyInfo = malloc(fmt->keyCount * sizeof(fieldInfoStruct));
+            if (keyInfo == NULL) {
+                free(kibuff);
+                f_freeFormat(fmt);
+                return NULL;
+            }
+            for (int j = 0; j < fmt->keyCount; j++) {
                 strLenToUtf(kyKey->Int_Field_Name, 10, keyInfo->name);
                 keyInfo->type = kyKey->Data_Type;
-                keyInfo->offset = fi->keyLen;
+                keyInfo->offset = fmt->keyLen;
                 keyInfo->len = kyKey->Field_Len;
                 keyInfo->digits = kyKey->Num_Of_Digs;
                 keyInfo->dec = kyKey->Dec_Pos;
                 // Use dft to set if descending key or not;
                 keyInfo->dft = ((1 << 7) & ((char *)kyKey)[28]) ? 1: 0;
                 /* get info from fieldArr */
-                for (i = 0; i < fi->fieldCount; i++) {
-                    fieldInfo = &fi->fieldArr[i];
+                for (i = 0; i < fmt->fieldCount; i++) {
+                    fieldInfo = &fmt->fieldArr[i];
                     if (!strcmp(fieldInfo->name, keyInfo->name)) {
                         strcpy(keyInfo->desc, fieldInfo->desc);
                         keyInfo->ccsid = fieldInfo->ccsid;
@@ -413,47 +819,167 @@ int fileInit(int fileno) {
                     }
                     fieldInfo++;
                 }
-                fi->keyLen += keyInfo->len;
+                fmt->keyLen += keyInfo->len;
                 keyInfo++;
                 kyKey++;
             }
         }
-        fi->keybuf = malloc(fi->keyLen + 1);
     }
     free(kibuff);
+    return fmt;
+}
+
+/* read header of file description, sets the library where the file is found */
+static int
+f_getFormatId(IntFileInfo *fi, FormatId *id, char *retFileLib, int *size)
+{
+    Qdb_Qddfmt_t foHd;
+    Qus_EC_t error;
+    char fileLib[21];
+
+    error.Bytes_Provided = sizeof(error);
+    utfToStrLen(fi->name, fileLib, 10, 0);
+    utfToStrLen(fi->lib, fileLib + 10, 10, 1);
+#pragma convert(37)
+    QDBRTVFD(&foHd, sizeof(foHd), retFileLib, "FILD0200", fileLib,
+                 "*FIRST    ", "0", "*LCL      ", "*EXT      ", &error);
+#pragma convert(0)
+    if (error.Bytes_Available > 0)
+        return -1;
+    strLenToUtf(retFileLib + 10, 10, fi->lib);
+    strcpy(id->lib, fi->lib);
+    strLenToUtf(foHd.Qddfname, 10, id->recName);
+    strLenToUtf(foHd.Qddfseq, 13, id->recId);
+    if (size != NULL)
+        *size = foHd.Qddbyava;
+    return 0;
+}
+
+/* let the handle use the format, the field arrays are shared read only */
+static void
+f_useFormat(IntFileInfo *fi, FormatInfo *fmt)
+{
+    fi->fmt = fmt;
+    strcpy(fi->recName, fmt->recName);
+    strcpy(fi->recId, fmt->recId);
+    fi->recLen = fmt->recLen;
+    fi->fieldCount = fmt->fieldCount;
+    fi->fieldArr = fmt->fieldArr;
+    fi->keyCount = fmt->keyCount;
+    fi->keyLen = fmt->keyLen;
+    fi->keyArr = fmt->keyArr;
+    fi->curKeyLen = 0;
+    fi->keybuf = malloc(fi->keyLen + 1);
     fi->recbuf = malloc(fi->recLen + 1);
-    fi->tmpbuf = malloc(fi->recLen + 1);
+}
+
+int fileInit(int fileno) {
+    FileHead *fh;
+    IntFileInfo *fi;
+    FormatInfo *fmt;
+    FormatId id;
+    char retFileLib[20];
+    int size;
+
+    // Get file structure
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    fi = fh->fi;
+    /* only the header, gives the library, format level id and size */
+    if (f_getFormatId(fi, &id, retFileLib, &size) < 0)
+        return -1;
+    fmt = f_findFormat(id.lib, fi->name, id.recId);
+    if (fmt == NULL) {
+        /* use the library found, the library list may change */
+        fmt = f_loadFormat(retFileLib, size);
+        if (fmt == NULL)
+            return -1;
+        fmt = f_addFormat(fmt);
+    }
+    f_useFormat(fi, fmt);
     /* return ok */
     return 0;
 }
 
+/* get the format level id of the file, to check a saved format */
+int fileGetFormatId(int fileno, FormatId *id) {
+    FileHead *fh;
+    char retFileLib[20];
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    return f_getFormatId(fh->fi, id, retFileLib, NULL);
+}
+
+/* init with a saved format instead of reading the file description */
+int fileSetFormat(int fileno, FileInfo *ei, fieldInfoStruct *fields, fieldInfoStruct *keys, FormatId *id) {
+    FileHead *fh;
+    IntFileInfo *fi;
+    FormatInfo *fmt;
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    fi = fh->fi;
+    fmt = f_findFormat(id->lib, fi->name, id->recId);
+    if (fmt == NULL) {
+        fmt = calloc(1, sizeof(FormatInfo));
+        strcpy(fmt->name, fi->name);
+        strcpy(fmt->lib, id->lib);
+        strcpy(fmt->recName, id->recName);
+        strcpy(fmt->recId, id->recId);
+        fmt->recLen = ei->recLen;
+        fmt->keyLen = ei->keyLen;
+        fmt->fieldCount = ei->fieldCount;
+        fmt->keyCount = ei->keyCount;
+        fmt->fieldArr = malloc(ei->fieldCount * sizeof(fieldInfoStruct));
+        memcpy(fmt->fieldArr, fields, ei->fieldCount * sizeof(fieldInfoStruct));
+        if (ei->keyCount > 0) {
+            fmt->keyArr = malloc(ei->keyCount * sizeof(fieldInfoStruct));
+            memcpy(fmt->keyArr, keys, ei->keyCount * sizeof(fieldInfoStruct));
+        }
+        fmt = f_addFormat(fmt);
+    }
+    strcpy(fi->lib, id->lib);
+    f_useFormat(fi, fmt);
+    return 0;
+}
+
 int fileOpen(int fileno) {
     char openKeyw[100];
     char fullName[35];
     FileHead *fh;
     IntFileInfo *fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (!fi->recbuf) {
         if (fileInit(fileno) < 0)
             return -1;
     }
-    sprintf(fullName, "%s/%s(%s)", fi->lib, fi->name, fi->mbr);
-    if (fi->omode == OPEN_READ) {
-        strcpy(openKeyw, "rr");
-    } else if (fi->omode == OPEN_WRITE) {
-        strcpy(openKeyw, "ar");
-    } else if (fi->omode == OPEN_UPDATE) {
-        strcpy(openKeyw, "rr+");
-    }
-    strcat(openKeyw, ", ccsid=65535");
-    if (fi->omode == OPEN_READ)
-        strcat(openKeyw, ", blkrcd=Y");
-    fh->fp = _Ropen(fullName, openKeyw);
+    /* reuse a pooled open data path */
+    fh->fp = f_poolGet(fi);
     if (!fh->fp) {
-        fprintf(stderr, "Open failed %s/%s\n", fi->lib, fi->name);
-        return -1;
+        sprintf(fullName, "%s/%s(%s)", fi->lib, fi->name, fi->mbr);
+        if (fi->omode == OPEN_READ || fi->omode == OPEN_ARRIVAL) {
+            strcpy(openKeyw, "rr");
+        } else if (fi->omode == OPEN_WRITE) {
+            strcpy(openKeyw, "ar");
+        } else if (fi->omode == OPEN_UPDATE) {
+            strcpy(openKeyw, "rr+");
+        }
+        strcat(openKeyw, ", ccsid=65535");
+        /* arrival sequence also when the file is keyed */
+        if (fi->omode == OPEN_ARRIVAL)
+            strcat(openKeyw, ", arrseq=Y");
+        /* blocked input, and blocked output when only writing */
+        if (fi->omode == OPEN_READ || fi->omode == OPEN_ARRIVAL || fi->omode == OPEN_WRITE)
+            strcat(openKeyw, ", blkrcd=Y");
+        fh->fp = _Ropen(fullName, openKeyw);
+        if (!fh->fp) {
+            fprintf(stderr, "Open failed %s/%s\n", fi->lib, fi->name);
+            return -1;
+        }
     }
     /* check record length */
     if (fh->fp->buf_length != fi->recLen) {
@@ -464,6 +990,7 @@ int fileOpen(int fileno) {
     if (fi->omode != OPEN_WRITE) {
         /* position to before first will also initialize iofb */
         _Rlocate(fh->fp, NULL, 0, __START);
+        fh->fp->riofb.blk_count = 0;
     }
     return 0;
 }
@@ -471,7 +998,8 @@ int fileOpen(int fileno) {
 int fileGetStruct(int fileno, FileInfo *ei) {
     FileHead *fh;
     IntFileInfo *fi;
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     strncpy(ei->name, fi->name, 11);
     strncpy(ei->lib, fi->lib, 11);
@@ -485,21 +1013,24 @@ int fileGetStruct(int fileno, FileInfo *ei) {
 
 int fileGetFields(int fileno, char *buf, int size) {
     FileHead *fh;
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     memcpy(buf, (char *)fh->fi->fieldArr, size);
     return 0;
 }
 
 int fileGetKeyFields(int fileno, char *buf, int size) {
     FileHead *fh;
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     memcpy(buf, (char *)fh->fi->keyArr, size);
     return 0;
 }
 
 int fileGetData(int fileno, char *buf, int size) {
     FileHead *fh;
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     memcpy(buf, fh->fi->recbuf, size);
     return 0;
 }
@@ -508,9 +1039,10 @@ int fileClose(int fileno) {
     FileHead *fh;
     IntFileInfo *fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
-    if (fh->fp && _Rclose(fh->fp)) {
+    if (fh->fp && f_poolPut(fi, fh->fp) < 0 && _Rclose(fh->fp)) {
         fprintf(stderr, "Error closing file. %s/%s\n", fh->fi->lib, fh->fi->name);
         return -1;
     }
@@ -519,25 +1051,61 @@ int fileClose(int fileno) {
 }
 
 int fileFree(int fileno) {
-    FileHead *fh;
+    FileHead *fh = NULL;
     IntFileInfo *fi;
+    HandleSlot *slot;
+    int index = fileno & (HANDLE_MAX - 1);
 
-    fh = fileArr[fileno];
+    /* take the handle out of the table, a stale handle is ignored */
+    pthread_mutex_lock(&handleMutex);
+    if (fileno >= 0 && index < handleCount) {
+        slot = f_slot(index);
+        if (slot->gen == (fileno >> HANDLE_BITS) && slot->fh != NULL) {
+            fh = slot->fh;
+            slot->fh = NULL;
+            slot->gen = (slot->gen + 1) & HANDLE_GEN_MASK;
+            slot->next = handleFree;
+            handleFree = index;
+        }
+    }
+    pthread_mutex_unlock(&handleMutex);
     if (fh) {
         fi = fh->fi;
+        if (fh->fp && f_poolPut(fi, fh->fp) < 0) _Rclose(fh->fp);
         if (fi->recbuf) free(fi->recbuf);
-        if (fi->tmpbuf) free(fi->tmpbuf);
         if (fi->keybuf) free(fi->keybuf);
-        if (fi->keyArr) free(fi->keyArr);
-        if (fi->fieldArr) free(fi->fieldArr);
-        if (fh->fp) _Rclose(fh->fp);
+        if (fi->fmt) f_releaseFormat(fi->fmt);
         free(fh->fi);
         free(fh);
-        fileArr[fileno] = NULL;
     }
     return 0;
 }
 
+/* set the pool limits, size 0 closes the pooled files and stops pooling */
+int poolConfig(int size, int idle) {
+    PoolEntry *old;
+    pthread_mutex_lock(&poolMutex);
+    poolMax = (size > 0) ? size : 0;
+    poolIdle = (idle > 0) ? idle : 0;
+    old = f_poolTrim(time(NULL));
+    pthread_mutex_unlock(&poolMutex);
+    f_poolClose(old);
+    return 0;
+}
+
+/* hits, misses, evicted, files in pool, max size, idle seconds */
+int poolStats(int *stats) {
+    pthread_mutex_lock(&poolMutex);
+    stats[0] = poolHits;
+    stats[1] = poolMisses;
+    stats[2] = poolEvicted;
+    stats[3] = poolCount;
+    stats[4] = poolMax;
+    stats[5] = poolIdle;
+    pthread_mutex_unlock(&poolMutex);
+    return 0;
+}
+
 int fileClear(int fileno) {
     int i;
     char *p, *buf;
@@ -545,7 +1113,8 @@ int fileClear(int fileno) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     buf = fi->recbuf;
@@ -599,7 +1168,8 @@ int fileClear(int fileno) {
 
 int fileRlsLock(int fileno) {
     FileHead * fh;
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     if (fh->fp && fh->fi->omode == OPEN_UPDATE)
         _Rrlslck(fh->fp);
     return 0;
@@ -610,7 +1180,8 @@ int filePosb(int fileno, char *key, int keyLen, int lock) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     fi->lmode = lock;
@@ -637,7 +1208,8 @@ int filePosa(int fileno, char *key, int keyLen, int lock) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     fi->lmode = lock;
@@ -659,7 +1231,8 @@ int filePosf(int fileno, int lock) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     fi->lmode = lock;
@@ -678,7 +1251,8 @@ int filePosl(int fileno, int lock) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     fi->lmode = lock;
@@ -698,7 +1272,8 @@ int fileReadeq(int fileno, char *recbuf, char *key, int keyLen, int lock) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     if (lock == 0) {
@@ -711,13 +1286,14 @@ int fileReadeq(int fileno, char *recbuf, char *key, int keyLen, int lock) {
         return -1;
     errno = 0;
     keyOpt = (lockOpt == __DFT) ? __KEY_EQ : __KEY_EQ | lockOpt;
-    _Rreadk(fh->fp, fi->recbuf, fi->recLen, keyOpt, fh->fp->riofb.key, keyLen);
+    /* locate mode, the record is copied once from the i/o buffer */
+    _Rreadk(fh->fp, NULL, fi->recLen, keyOpt, fh->fp->riofb.key, keyLen);
     if (errno != 0 && errno != EIORECERR) {
         fprintf(stderr, "%s %s/%s\n", strerror(errno), fi->lib, fi->name);
         return -1;
     }
     if (fh->fp->riofb.num_bytes == fi->recLen) {
-        memcpy(recbuf, fi->recbuf, fi->recLen);
+        memcpy(recbuf, (char *)*(fh->fp->in_buf), fi->recLen);
         return 0;
     }
     return 1;
@@ -728,7 +1304,8 @@ int fileReadrrn(int fileno, char *recbuf, int rrn, int lock) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     if (lock == 0) {
@@ -737,22 +1314,25 @@ int fileReadrrn(int fileno, char *recbuf, int rrn, int lock) {
             _Rrlslck(fh->fp);
     }
     errno = 0;
-    _Rreadd(fh->fp, fi->recbuf, fi->recLen, lockOpt, rrn);
+    _Rreadd(fh->fp, NULL, fi->recLen, lockOpt, rrn);
     if (errno != 0 && errno != EIORECERR) {
         fprintf(stderr, "%s %s/%s\n", strerror(errno), fi->lib, fi->name);
         return -1;
     }
     if (fh->fp->riofb.num_bytes == fi->recLen) {
-        memcpy(recbuf, fi->recbuf, fi->recLen);
+        memcpy(recbuf, (char *)*(fh->fp->in_buf), fi->recLen);
         return 0;
     }
     return 1;
 }
 
+/* read a record in locate mode, it is left in the i/o buffer */
 static int
-f_readCommon(FileHead *fh, char *recbuf, int oper, int lock, int keyLen) {
+f_readLocate(FileHead *fh, int oper, int lock, int keyLen) {
     int lockOpt = __DFT;
-    IntFileInfo *fi = fh->fi;
+    IntFileInfo *fi;
+    if (fh == NULL) return -1;
+    fi = fh->fi;
     // Open if not already opened
     if (f_open(fh) < 0) return -1;
     if (lock == -1) {
@@ -790,18 +1370,18 @@ f_readCommon(FileHead *fh, char *recbuf, int oper, int lock, int keyLen) {
     errno = 0;
     switch (oper) {
         case 1:
-            _Rreadf(fh->fp, fi->recbuf, fi->recLen, lockOpt);
+            _Rreadf(fh->fp, NULL, fi->recLen, lockOpt);
             break;
         case 2:
-            _Rreadl(fh->fp, fi->recbuf, fi->recLen, lockOpt);
+            _Rreadl(fh->fp, NULL, fi->recLen, lockOpt);
             break;
         case 11:
         case 21:
-            _Rreadn(fh->fp, fi->recbuf, fi->recLen, lockOpt);
+            _Rreadn(fh->fp, NULL, fi->recLen, lockOpt);
             break;
         case 12:
         case 22:
-            _Rreadp(fh->fp, fi->recbuf, fi->recLen, lockOpt);
+            _Rreadp(fh->fp, NULL, fi->recLen, lockOpt);
             break;
     }
     if (errno != 0 && errno != EIORECERR) {
@@ -817,50 +1397,756 @@ f_readCommon(FileHead *fh, char *recbuf, int oper, int lock, int keyLen) {
             return 1;
         }
     }
-    if (fh->fp->riofb.num_bytes == fi->recLen) {
-        memcpy(recbuf, fi->recbuf, fi->recLen);
-        return 0;
+    return (fh->fp->riofb.num_bytes == fi->recLen) ? 0 : 1;
+}
+
+/* read a record, it is copied to the caller only when found */
+static int
+f_readCommon(FileHead *fh, char *recbuf, int oper, int lock, int keyLen) {
+    int result = f_readLocate(fh, oper, lock, keyLen);
+    if (result == 0)
+        memcpy(recbuf, (char *)*(fh->fp->in_buf), fh->fi->recLen);
+    return result;
+}
+
+/* compare packed or zoned values, the digits are compared without conversion */
+static int
+f_decCmp(unsigned char *p1, unsigned char *p2, fieldInfoStruct *field)
+{
+    int i, j, n, d1, d2, neg1, neg2, cmp = 0;
+    n = field->digits;
+    if (field->type == 3) {
+        neg1 = (p1[n / 2] & 0x0f) == 0x0d || (p1[n / 2] & 0x0f) == 0x0b;
+        neg2 = (p2[n / 2] & 0x0f) == 0x0d || (p2[n / 2] & 0x0f) == 0x0b;
+    } else {
+        neg1 = (p1[n - 1] & 0xf0) == 0xd0 || (p1[n - 1] & 0xf0) == 0xb0;
+        neg2 = (p2[n - 1] & 0xf0) == 0xd0 || (p2[n - 1] & 0xf0) == 0xb0;
+    }
+    /* compare the absolute values digit by digit */
+    for (i = 0; i < n && cmp == 0; i++) {
+        if (field->type == 3) {
+            /* even number of digits has a leading pad nibble */
+            j = i + 1 - (n & 1);
+            d1 = (j & 1) ? p1[j / 2] & 0x0f : p1[j / 2] >> 4;
+            d2 = (j & 1) ? p2[j / 2] & 0x0f : p2[j / 2] >> 4;
+        } else {
+            d1 = p1[i] & 0x0f;
+            d2 = p2[i] & 0x0f;
+        }
+        cmp = d1 - d2;
+    }
+    if (cmp == 0) {
+        /* equal absolute values, zero is equal whatever the sign */
+        if (neg1 == neg2)
+            return 0;
+        for (i = 0; i < n; i++) {
+            if (field->type == 3) {
+                j = i + 1 - (n & 1);
+                d1 = (j & 1) ? p1[j / 2] & 0x0f : p1[j / 2] >> 4;
+            } else
+                d1 = p1[i] & 0x0f;
+            if (d1 != 0)
+                break;
+        }
+        if (i == n)
+            return 0;
+        return neg1 ? -1 : 1;
+    }
+    if (neg1 != neg2)
+        return neg1 ? -1 : 1;
+    return neg1 ? -cmp : cmp;
+}
+
+/* compare field value with raw value in the same format */
+static int
+f_fieldCmp(char *p1, char *p2, fieldInfoStruct *field)
+{
+    short s1, s2, l1, l2;
+    int i1, i2, cmp;
+    long long ll1, ll2;
+    float f1, f2;
+    double d1, d2;
+
+    switch (field->type) {
+    /* binary */
+    case 0:
+        if (field->len == 2) {
+            memcpy(&s1, p1, 2);
+            memcpy(&s2, p2, 2);
+            return (s1 > s2) - (s1 < s2);
+        } else if (field->len == 4) {
+            memcpy(&i1, p1, 4);
+            memcpy(&i2, p2, 4);
+            return (i1 > i2) - (i1 < i2);
+        }
+        memcpy(&ll1, p1, 8);
+        memcpy(&ll2, p2, 8);
+        return (ll1 > ll2) - (ll1 < ll2);
+    /* float */
+    case 1:
+        if (field->len == 4) {
+            memcpy(&f1, p1, 4);
+            memcpy(&f2, p2, 4);
+            return (f1 > f2) - (f1 < f2);
+        }
+        memcpy(&d1, p1, 8);
+        memcpy(&d2, p2, 8);
+        return (d1 > d2) - (d1 < d2);
+    /* zoned, packed */
+    case 2: case 3:
+        return f_decCmp((unsigned char *)p1, (unsigned char *)p2, field);
+    /* varchar, vargraphic, the length is in characters */
+    case 0x8004: case 0x8005:
+        memcpy(&l1, p1, 2);
+        memcpy(&l2, p2, 2);
+        cmp = memcmp(p1 + 2, p2 + 2, ((l1 < l2) ? l1 : l2) * ((field->type == 0x8005) ? 2 : 1));
+        if (cmp == 0)
+            cmp = l1 - l2;
+        return cmp;
+    /* char, graphic, date, time, timestamp */
+    default:
+        return memcmp(p1, p2, field->len);
+    }
+}
+
+/* check the predicate program against the file */
+static int
+f_checkPred(IntFileInfo *fi, PredProgram *prog)
+{
+    PredCond *cond;
+    char *p, *e;
+    int i;
+
+    if (prog->endCnt < 0 || prog->endCnt > fi->keyCount || prog->endLen < 0)
+        return -1;
+    p = (char *)(prog + 1) + prog->endLen;
+    e = (char *)prog + prog->size;
+    for (i = 0; i < prog->count; i++) {
+        cond = (PredCond *)p;
+        if (p + sizeof(PredCond) > e || cond->field < 0 || cond->field >= fi->fieldCount)
+            return -1;
+        p = (char *)(cond + 1) + cond->size;
+        if (p > e || cond->size < cond->count * ((fi->fieldArr[cond->field].len + 3) & ~3))
+            return -1;
+        if (cond->op != PRED_FALSE && cond->count < 1)
+            return -1;
+    }
+    return 0;
+}
+
+/* check if the record matches all conditions */
+static int
+f_match(IntFileInfo *fi, char *rec, PredProgram *prog)
+{
+    PredCond *cond;
+    fieldInfoStruct *field;
+    char *p, *val;
+    int i, j, cmp, len, ok;
+
+    p = (char *)(prog + 1) + prog->endLen;
+    for (i = 0; i < prog->count; i++) {
+        cond = (PredCond *)p;
+        /* a value the field can not hold makes the condition never true */
+        if (cond->op == PRED_FALSE)
+            return 0;
+        field = &fi->fieldArr[cond->field];
+        len = (field->len + 3) & ~3;
+        val = (char *)(cond + 1);
+        p = val + cond->size;
+        cmp = f_fieldCmp(rec + field->offset, val, field);
+        switch (cond->op) {
+        case PRED_EQ:
+            ok = (cmp == 0);
+            break;
+        case PRED_NE:
+            ok = (cmp != 0);
+            break;
+        case PRED_LT:
+            ok = (cmp < 0);
+            break;
+        case PRED_LE:
+            ok = (cmp <= 0);
+            break;
+        case PRED_GT:
+            ok = (cmp > 0);
+            break;
+        case PRED_GE:
+            ok = (cmp >= 0);
+            break;
+        case PRED_IN:
+            for (j = 1; cmp != 0 && j < cond->count; j++)
+                cmp = f_fieldCmp(rec + field->offset, val + j * len, field);
+            ok = (cmp == 0);
+            break;
+        case PRED_BETWEEN:
+            ok = (cmp >= 0 && f_fieldCmp(rec + field->offset, val + len, field) <= 0);
+            break;
+        default:
+            ok = 0;
+        }
+        if (!ok)
+            return 0;
     }
     return 1;
 }
 
+/* check if the key of the record read is past the end key */
+static int
+f_pastEndKey(IntFileInfo *fi, char *key, char *endKey, int endCnt)
+{
+    fieldInfoStruct *k;
+    int i, cmp;
+
+    for (i = 0; i < endCnt; i++) {
+        k = &fi->keyArr[i];
+        cmp = f_fieldCmp(key + k->offset, endKey + k->offset, k);
+        /* descending key */
+        if (k->dft)
+            cmp = -cmp;
+        if (cmp != 0)
+            return cmp > 0;
+    }
+    return 0;
+}
+
 int fileReadf(int fileno, char *recbuf, int lock) {
-    return f_readCommon(fileArr[fileno], recbuf, 1, lock, 0);
+    return f_readCommon(f_getHead(fileno), recbuf, 1, lock, 0);
 }
 
 int fileReadl(int fileno, char *recbuf, int lock) {
-    return f_readCommon(fileArr[fileno], recbuf, 2, lock, 0);
+    return f_readCommon(f_getHead(fileno), recbuf, 2, lock, 0);
 }
 
 int fileReadn(int fileno, char *recbuf, int lock) {
-    return f_readCommon(fileArr[fileno], recbuf, 11, lock, 0);
+    return f_readCommon(f_getHead(fileno), recbuf, 11, lock, 0);
 }
 
 int fileReadp(int fileno, char *recbuf, int lock) {
-    return f_readCommon(fileArr[fileno], recbuf, 12, lock, 0);
+    return f_readCommon(f_getHead(fileno), recbuf, 12, lock, 0);
 }
 
 int fileReadne(int fileno, char *recbuf, int keyLen, int lock) {
-    return f_readCommon(fileArr[fileno], recbuf, 21, lock, keyLen);
+    return f_readCommon(f_getHead(fileno), recbuf, 21, lock, keyLen);
 }
 
 int fileReadpe(int fileno, char *recbuf, int keyLen, int lock) {
-    return f_readCommon(fileArr[fileno], recbuf, 22, lock, keyLen);
+    return f_readCommon(f_getHead(fileno), recbuf, 22, lock, keyLen);
+}
+
+/* read up to n records (readn or readne) into buf, the rrn of each record in rrns */
+int fileReadmany(int fileno, char *buf, int *rrns, int n, int oper, int keyLen, int lock) {
+    FileHead * fh;
+    int i, result;
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    if (oper != 11 && oper != 21) {
+        fprintf(stderr, "Read operation not valid for readmany. %s/%s\n", fh->fi->lib, fh->fi->name);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        result = f_readCommon(fh, buf + i * fh->fi->recLen, oper, lock, keyLen);
+        if (result == -1)
+            return -1;
+        if (result == 1)
+            break;
+        rrns[i] = fh->fp->riofb.rrn;
+        /* the key length is kept from the first read */
+        keyLen = 0;
+    }
+    return i;
+}
+
+/*
+ * Run n batch commands with one call. recbuf is the record buffer, reads
+ * fill it and write/update patch it first. status gets the result and rrn
+ * of each command, records found are stored in recs one after another.
+ * Stops at the first command that fails, returns the number of commands run.
+ */
+int fileExecute(int fileno, char *cmds, int n, char *recbuf, int *status, char *recs) {
+    FileHead *fh;
+    CmdHead *cmd;
+    CmdPatch *patch;
+    char *data, *p;
+    int i, j, result, read;
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    if (f_open(fh) < 0) return -1;
+    for (i = 0; i < n; i++) {
+        cmd = (CmdHead *)cmds;
+        data = cmds + sizeof(CmdHead);
+        cmds = data + cmd->size;
+        read = 0;
+        switch (cmd->oper) {
+        case CMD_POSB:
+            result = filePosb(fileno, data, cmd->arg, cmd->lock);
+            break;
+        case CMD_POSA:
+            result = filePosa(fileno, data, cmd->arg, cmd->lock);
+            break;
+        case CMD_POSF:
+            result = filePosf(fileno, cmd->lock);
+            break;
+        case CMD_POSL:
+            result = filePosl(fileno, cmd->lock);
+            break;
+        case CMD_READEQ:
+            result = fileReadeq(fileno, recbuf, data, cmd->arg, cmd->lock);
+            read = 1;
+            break;
+        case CMD_READRRN:
+            result = fileReadrrn(fileno, recbuf, cmd->arg, cmd->lock);
+            read = 1;
+            break;
+        case 1: case 2: case 11: case 12: case 21: case 22:
+            result = f_readCommon(fh, recbuf, cmd->oper, cmd->lock, cmd->arg);
+            read = 1;
+            break;
+        case CMD_WRITE:
+        case CMD_UPDATE:
+            result = 0;
+            p = data;
+            for (j = 0; j < cmd->arg; j++) {
+                patch = (CmdPatch *)p;
+                if (patch->offset < 0 || patch->offset + patch->len > fh->fi->recLen) {
+                    fprintf(stderr, "Field patch not valid. %s/%s\n", fh->fi->lib, fh->fi->name);
+                    result = -1;
+                    break;
+                }
+                memcpy(recbuf + patch->offset, p + sizeof(CmdPatch), patch->len);
+                p += sizeof(CmdPatch) + ((patch->len + 3) & ~3);
+            }
+            if (result == 0)
+                result = (cmd->oper == CMD_WRITE) ? fileWrite(fileno, recbuf) : fileUpdate(fileno, recbuf);
+            break;
+        case CMD_DELETE:
+            result = fileDelete(fileno);
+            break;
+        case CMD_RLSLOCK:
+            result = fileRlsLock(fileno);
+            break;
+        default:
+            fprintf(stderr, "Batch command not valid. %s/%s\n", fh->fi->lib, fh->fi->name);
+            result = -1;
+        }
+        status[2 * i] = result;
+        status[2 * i + 1] = 0;
+        if (result == -1)
+            break;
+        if (read && result == 0) {
+            status[2 * i + 1] = fh->fp->riofb.rrn;
+            memcpy(recs, recbuf, fh->fi->recLen);
+            recs += fh->fi->recLen;
+        }
+    }
+    return i;
+}
+
+/* check the byte ranges to read: count, size, then offset and length of each */
+static int
+f_checkRanges(IntFileInfo *fi, int *ranges)
+{
+    int i, size = 0;
+    if (ranges[0] <= 0)
+        return -1;
+    for (i = 0; i < ranges[0]; i++) {
+        if (ranges[2 + 2 * i] < 0 || ranges[3 + 2 * i] <= 0 ||
+            ranges[2 + 2 * i] + ranges[3 + 2 * i] > fi->recLen)
+            return -1;
+        size += ranges[3 + 2 * i];
+    }
+    return (size == ranges[1]) ? 0 : -1;
+}
+
+/*
+ * read up to n records (readn or readne) that match the predicate program,
+ * the others are skipped in the i/o buffer and never copied.
+ * Stops at end of file, at a record past the end key of the program or
+ * at a record after the rrn toRrn, 0 if no limit.
+ * Without program all records are read, with byte ranges only those
+ * parts of the record are copied, one after another. recbuf, if given,
+ * gets the whole record so it holds the last one read.
+ */
+static int
+f_readWhere(FileHead *fh, char *buf, int *rrns, int n, int oper, int keyLen, int lock,
+            PredProgram *prog, int *ranges, int toRrn, char *recbuf) {
+    IntFileInfo * fi;
+    char *rec, *p;
+    int i = 0, j, result;
+
+    if (fh == NULL) return -1;
+    if (oper != 11 && oper != 21) {
+        fprintf(stderr, "Read operation not valid for block read. %s/%s\n", fh->fi->lib, fh->fi->name);
+        return -1;
+    }
+    if (f_init(fh) < 0) return -1;
+    fi = fh->fi;
+    if (prog != NULL && f_checkPred(fi, prog) < 0) {
+        fprintf(stderr, "Predicate not valid. %s/%s\n", fi->lib, fi->name);
+        return -1;
+    }
+    if (ranges != NULL && f_checkRanges(fi, ranges) < 0) {
+        fprintf(stderr, "Field selection not valid. %s/%s\n", fi->lib, fi->name);
+        return -1;
+    }
+    while (i < n) {
+        result = f_readLocate(fh, oper, lock, keyLen);
+        if (result == -1)
+            return -1;
+        if (result == 1)
+            break;
+        /* the key length is kept from the first read */
+        keyLen = 0;
+        if (toRrn > 0 && fh->fp->riofb.rrn > toRrn)
+            break;
+        rec = (char *)*(fh->fp->in_buf);
+        if (prog != NULL && prog->endCnt > 0 &&
+            f_pastEndKey(fi, fh->fp->riofb.key, (char *)(prog + 1), prog->endCnt)) {
+            if (fi->omode == OPEN_UPDATE)
+                _Rrlslck(fh->fp);
+            break;
+        }
+        if (prog != NULL && !f_match(fi, rec, prog)) {
+            if (fi->omode == OPEN_UPDATE)
+                _Rrlslck(fh->fp);
+            continue;
+        }
+        if (ranges == NULL)
+            memcpy(buf + (size_t)i * fi->recLen, rec, fi->recLen);
+        else {
+            p = buf + (size_t)i * ranges[1];
+            for (j = 0; j < ranges[0]; j++) {
+                memcpy(p, rec + ranges[2 + 2 * j], ranges[3 + 2 * j]);
+                p += ranges[3 + 2 * j];
+            }
+            if (recbuf != NULL)
+                memcpy(recbuf, rec, fi->recLen);
+        }
+        rrns[i++] = fh->fp->riofb.rrn;
+    }
+    return i;
+}
+
+/* check the aggregate spec against the file */
+static int
+f_checkAgg(IntFileInfo *fi, AggSpec *as)
+{
+    AggDef *ad = (AggDef *)(as + 1);
+    fieldInfoStruct *field;
+    int i;
+
+    if (as->count < 0 || as->groupLen < 0 || as->groupLen > fi->keyLen ||
+        as->countOffset < as->groupLen || as->countOffset + 8 > as->outLen ||
+        as->curOffset < sizeof(AggSpec) + as->count * sizeof(AggDef) ||
+        as->curOffset + as->outLen > as->size)
+        return -1;
+    for (i = 0; i < as->count; i++) {
+        if (ad[i].field < 0 || ad[i].field >= fi->fieldCount ||
+            ad[i].offset < as->countOffset + 8 || ad[i].offset + ad[i].len > as->outLen)
+            return -1;
+        field = &fi->fieldArr[ad[i].field];
+        if (ad[i].op == AGG_SUM) {
+            if (field->type > 3 || ad[i].len != 16)
+                return -1;
+        } else if (ad[i].op == AGG_MIN || ad[i].op == AGG_MAX) {
+            /* date and time compare as bytes only in some formats */
+            if (ad[i].len < field->len || field->type == 11 || field->type == 12)
+                return -1;
+        } else
+            return -1;
+    }
+    return 0;
+}
+
+/* 128 bit integer as four 32 bit words, most significant first */
+typedef struct {
+	unsigned int w[4];
+} Int128;
+
+/* m = m * mul + add, -1 on overflow */
+static int
+f_mulAdd128(Int128 *m, unsigned int mul, unsigned int add)
+{
+    unsigned long long t;
+    int i;
+    t = add;
+    for (i = 3; i >= 0; i--) {
+        t += (unsigned long long)m->w[i] * mul;
+        m->w[i] = (unsigned int)t;
+        t >>= 32;
+    }
+    return (t != 0 || (m->w[0] & 0x80000000)) ? -1 : 0;
+}
+
+static void
+f_neg128(Int128 *m)
+{
+    unsigned long long t = 1;
+    int i;
+    for (i = 3; i >= 0; i--) {
+        t += (unsigned int)~m->w[i];
+        m->w[i] = (unsigned int)t;
+        t >>= 32;
+    }
+}
+
+/* sum += v, -1 on overflow */
+static int
+f_add128(Int128 *sum, Int128 *v)
+{
+    unsigned long long t = 0;
+    unsigned int s1 = sum->w[0] >> 31, s2 = v->w[0] >> 31;
+    int i;
+    for (i = 3; i >= 0; i--) {
+        t += (unsigned long long)sum->w[i] + v->w[i];
+        sum->w[i] = (unsigned int)t;
+        t >>= 32;
+    }
+    return (s1 == s2 && (sum->w[0] >> 31) != s1) ? -1 : 0;
+}
+
+/* binary, zoned or packed value as a 128 bit integer, the decimals are kept */
+static int
+f_to128(char *p, fieldInfoStruct *field, Int128 *v)
+{
+    unsigned char *u = (unsigned char *)p;
+    unsigned int chunk = 0, mul = 1;
+    long long ll;
+    short s;
+    int i, j, d, n, neg, i4;
+
+    memset(v, 0, sizeof(Int128));
+    if (field->type == 0) {
+        if (field->len == 2) {
+            memcpy(&s, p, 2);
+            ll = s;
+        } else if (field->len == 4) {
+            memcpy(&i4, p, 4);
+            ll = i4;
+        } else
+            memcpy(&ll, p, 8);
+        if (ll < 0)
+            v->w[0] = v->w[1] = 0xffffffff;
+        v->w[2] = (unsigned int)((unsigned long long)ll >> 32);
+        v->w[3] = (unsigned int)ll;
+        return 0;
+    }
+    n = field->digits;
+    if (field->type == 3)
+        neg = (u[n / 2] & 0x0f) == 0x0d || (u[n / 2] & 0x0f) == 0x0b;
+    else
+        neg = (u[n - 1] & 0xf0) == 0xd0 || (u[n - 1] & 0xf0) == 0xb0;
+    /* nine digits at a time */
+    for (i = 0; i < n; i++) {
+        if (field->type == 3) {
+            /* even number of digits has a leading pad nibble */
+            j = i + 1 - (n & 1);
+            d = (j & 1) ? u[j / 2] & 0x0f : u[j / 2] >> 4;
+        } else
+            d = u[i] & 0x0f;
+        chunk = chunk * 10 + d;
+        mul *= 10;
+        if (mul == 1000000000 || i == n - 1) {
+            if (f_mulAdd128(v, mul, chunk) < 0)
+                return -1;
+            chunk = 0;
+            mul = 1;
+        }
+    }
+    if (neg)
+        f_neg128(v);
+    return 0;
+}
+
+/* add the record to the open group */
+static int
+f_aggAdd(IntFileInfo *fi, AggSpec *as, char *cur, char *rec)
+{
+    AggDef *ad = (AggDef *)(as + 1);
+    fieldInfoStruct *field;
+    long long count;
+    Int128 v, sum;
+    double dsum, d;
+    float f;
+    char *p, *val;
+    int i;
+
+    memcpy(&count, cur + as->countOffset, 8);
+    for (i = 0; i < as->count; i++) {
+        field = &fi->fieldArr[ad[i].field];
+        p = rec + field->offset;
+        val = cur + ad[i].offset;
+        switch (ad[i].op) {
+        case AGG_SUM:
+            if (field->type == 1) {
+                /* float, the sum is a double */
+                memcpy(&dsum, val, 8);
+                if (field->len == 4) {
+                    memcpy(&f, p, 4);
+                    d = f;
+                } else
+                    memcpy(&d, p, 8);
+                dsum += d;
+                memcpy(val, &dsum, 8);
+                break;
+            }
+            memcpy(&sum, val, 16);
+            if (f_to128(p, field, &v) < 0 || f_add128(&sum, &v) < 0) {
+                fprintf(stderr, "Sum overflow %s. %s/%s\n", field->name, fi->lib, fi->name);
+                return -1;
+            }
+            memcpy(val, &sum, 16);
+            break;
+        case AGG_MIN:
+            if (count == 0 || f_fieldCmp(p, val, field) < 0)
+                memcpy(val, p, field->len);
+            break;
+        case AGG_MAX:
+            if (count == 0 || f_fieldCmp(p, val, field) > 0)
+                memcpy(val, p, field->len);
+            break;
+        }
+    }
+    count++;
+    memcpy(cur + as->countOffset, &count, 8);
+    return 0;
+}
+
+/*
+ * Aggregate the records from the current position, grouped by the first
+ * key fields. The records come in key order, so a group is done when the
+ * key changes. Returns the number of groups put in out, at most max.
+ * The open group is kept in the spec, call again until the state is AGG_DONE.
+ * No record is locked, pred can be NULL.
+ */
+int fileAggregate(int fileno, char *pred, char *spec, char *out, int max) {
+    PredProgram *prog = (PredProgram *)pred;
+    AggSpec *as = (AggSpec *)spec;
+    FileHead * fh;
+    IntFileInfo * fi;
+    char *rec, *key, *cur;
+    long long count;
+    int groups = 0, result;
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    if (f_init(fh) < 0) return -1;
+    fi = fh->fi;
+    if (prog != NULL && f_checkPred(fi, prog) < 0) {
+        fprintf(stderr, "Predicate not valid. %s/%s\n", fi->lib, fi->name);
+        return -1;
+    }
+    if (f_checkAgg(fi, as) < 0) {
+        fprintf(stderr, "Aggregate not valid. %s/%s\n", fi->lib, fi->name);
+        return -1;
+    }
+    cur = spec + as->curOffset;
+    while (as->state == AGG_READ) {
+        if (groups == max)
+            return groups;
+        result = f_readLocate(fh, 11, 0, 0);
+        if (result == -1)
+            return -1;
+        if (result == 1) {
+            as->state = AGG_END;
+            break;
+        }
+        rec = (char *)*(fh->fp->in_buf);
+        key = fh->fp->riofb.key;
+        if (prog != NULL && prog->endCnt > 0 &&
+            f_pastEndKey(fi, key, (char *)(prog + 1), prog->endCnt)) {
+            as->state = AGG_END;
+            break;
+        }
+        if (prog != NULL && !f_match(fi, rec, prog))
+            continue;
+        /* a new group, the open one is done */
+        memcpy(&count, cur + as->countOffset, 8);
+        if (count > 0 && memcmp(cur, key, as->groupLen) != 0) {
+            memcpy(out + (size_t)groups * as->outLen, cur, as->outLen);
+            groups++;
+            memset(cur, 0, as->outLen);
+            count = 0;
+        }
+        if (count == 0)
+            memcpy(cur, key, as->groupLen);
+        if (f_aggAdd(fi, as, cur, rec) < 0)
+            return -1;
+    }
+    /* the last group */
+    if (as->state == AGG_END && groups < max) {
+        memcpy(&count, cur + as->countOffset, 8);
+        if (count > 0) {
+            memcpy(out + (size_t)groups * as->outLen, cur, as->outLen);
+            groups++;
+        }
+        as->state = AGG_DONE;
+    }
+    return groups;
+}
+
+int fileReadwhere(int fileno, char *buf, int *rrns, int n, int oper, int keyLen, int lock, char *pred) {
+    return f_readWhere(f_getHead(fileno), buf, rrns, n, oper, keyLen, lock, (PredProgram *)pred, NULL, 0, NULL);
+}
+
+/*
+ * as fileReadwhere, copies only the byte ranges of the selected fields, pred can be NULL.
+ * recbuf can be NULL, else it gets the last record read.
+ */
+int fileReadselect(int fileno, char *buf, int *rrns, int n, int oper, int keyLen, int lock,
+                   char *pred, int *ranges, char *recbuf) {
+    return f_readWhere(f_getHead(fileno), buf, rrns, n, oper, keyLen, lock, (PredProgram *)pred, ranges, 0, recbuf);
+}
+
+/*
+ * Read up to n records of the rrn range from - to, as fileReadselect.
+ * The file must be opened in arrival sequence. from > 0 positions on the
+ * first record of the range, deleted records are skipped, 0 continues
+ * after the last call. Returns less than n at the end of the range.
+ */
+int fileReadrange(int fileno, char *buf, int *rrns, int n, int from, int to,
+                  char *pred, int *ranges) {
+    FileHead * fh;
+    IntFileInfo * fi;
+    int rrn;
+
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    fi = fh->fi;
+    if (f_open(fh) < 0) return -1;
+    if (fi->omode != OPEN_ARRIVAL) {
+        fprintf(stderr, "File not opened in arrival sequence. %s/%s\n", fi->lib, fi->name);
+        return -1;
+    }
+    if (from > 0) {
+        for (rrn = from; rrn <= to; rrn++) {
+            errno = 0;
+            _Rlocate(fh->fp, NULL, rrn, __RRN_EQ|__PRIOR|__NO_LOCK);
+            if (fh->fp->riofb.num_bytes != 0)
+                break;
+        }
+        fh->fp->riofb.blk_count = 0;
+        if (rrn > to)
+            return 0;
+    }
+    return f_readWhere(fh, buf, rrns, n, 11, 0, 0, (PredProgram *)pred, ranges, to, NULL);
 }
 
 int fileWrite(int fileno, char *buf) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
-    memcpy(fi->recbuf, buf, fi->recLen);
     /* save the key and restore it after write */
     if (fi->keyLen > 0)
         memcpy(fi->keybuf, fh->fp->riofb.key, fi->keyLen);
-    _Rwrite(fh->fp, fi->recbuf, fi->recLen);
-    if (fh->fp->riofb.num_bytes < fi->recLen) {
+    _Rwrite(fh->fp, buf, fi->recLen);
+    /* output is blocked in write mode, one record is written at once */
+    if (fh->fp->riofb.num_bytes < fi->recLen || (fi->omode == OPEN_WRITE && _Rfeod(fh->fp) < 0)) {
         fprintf(stderr, "Error writing record. %s/%s\n", fi->lib, fi->name);
         return -1;
     }
@@ -869,18 +2155,59 @@ int fileWrite(int fileno, char *buf) {
     return 0;
 }
 
+/*
+ * Write n records from buf, blocked when the file is opened for write.
+ * The block is forced out at the end so errors are reported here.
+ * Returns the number written, on error -1 and the index of the record
+ * where the error was reported in failed. Blocked, the records up to
+ * failed may or may not be written, the last one if forcing out failed.
+ */
+int fileWriteBlock(int fileno, char *buf, int n, int *failed) {
+    FileHead * fh;
+    IntFileInfo * fi;
+    int i;
+
+    *failed = 0;
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    fi = fh->fi;
+    if (f_open(fh) < 0) return -1;
+    if (fi->omode == OPEN_READ || fi->omode == OPEN_ARRIVAL) {
+        fprintf(stderr, "File not opened for write. %s/%s\n", fi->lib, fi->name);
+        return -1;
+    }
+    if (fi->keyLen > 0)
+        memcpy(fi->keybuf, fh->fp->riofb.key, fi->keyLen);
+    for (i = 0; i < n; i++) {
+        _Rwrite(fh->fp, buf + (size_t)i * fi->recLen, fi->recLen);
+        if (fh->fp->riofb.num_bytes < fi->recLen) {
+            fprintf(stderr, "Error writing record %d. %s/%s\n", i, fi->lib, fi->name);
+            *failed = i;
+            return -1;
+        }
+    }
+    if (fi->omode == OPEN_WRITE && n > 0 && _Rfeod(fh->fp) < 0) {
+        fprintf(stderr, "Error writing block. %s/%s\n", fi->lib, fi->name);
+        *failed = n - 1;
+        return -1;
+    }
+    if (fi->keyLen > 0)
+        memcpy(fh->fp->riofb.key, fi->keybuf, fi->keyLen);
+    return n;
+}
+
 int fileUpdate(int fileno, char *buf) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
-    memcpy(fi->recbuf, buf, fi->recLen);
     /* save the key and restore it after update */
     if (fi->keyLen > 0)
         memcpy(fi->keybuf, fh->fp->riofb.key, fi->keyLen);
-    _Rupdate(fh->fp, fi->recbuf, fi->recLen);
+    _Rupdate(fh->fp, buf, fi->recLen);
     if (fh->fp->riofb.num_bytes < fi->recLen) {
         fprintf(stderr, "Error updating record. %s/%s\n", fi->lib, fi->name);
         return -1;
@@ -894,7 +2221,8 @@ int fileDelete(int fileno) {
     FileHead * fh;
     IntFileInfo * fi;
 
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
     fi = fh->fi;
     if (f_open(fh) < 0) return -1;
     /* save the key and restore it after delete */
@@ -912,7 +2240,10 @@ int fileDelete(int fileno) {
 
 int fileGetRrn(int fileno) {
     FileHead * fh;
-    fh = fileArr[fileno];
+    fh = f_getHead(fileno);
+    if (fh == NULL) return -1;
+    /* not opened yet, no record read */
+    if (fh->fp == NULL) return 0;
     return fh->fp->riofb.rrn;
 }
 